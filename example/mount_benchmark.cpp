@@ -0,0 +1,157 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <fusekit/daemon.h>
+#include <fusekit/memory_file.h>
+#include <fusekit/mount_options.h>
+#include <fusekit/mutex_lock.h>
+
+/// example benchmarks the presets of fusekit::mount_options.
+///
+/// the file system is a directory of memory files. it is mounted with
+/// each preset in turn and the same workload runs against it: large
+/// sequential writes and reads, then many small files which are created,
+/// stat'ed and read. the results are printed as a table. the presets
+/// other than defaults are multithreaded and the workload changes the
+/// tree, so the daemon serializes the operations with mutex_lock.
+/// $mount_benchmark mountpoint [megabytes] [files]
+typedef fusekit::default_directory<
+  fusekit::directory_factory<>,
+  fusekit::file_factory< fusekit::memory_file_creator >
+  >::type bench_directory;
+
+typedef fusekit::daemon< bench_directory, fusekit::mutex_lock > bench_daemon;
+
+static double now(){
+  struct timespec t;
+  clock_gettime( CLOCK_MONOTONIC, &t );
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/// waits until the file system is mounted over mountpoint.
+static bool mounted( const std::string& mountpoint, dev_t parent ){
+  for( int i = 0; i < 500; ++i ){
+    struct stat st;
+    if( ::stat( mountpoint.c_str(), &st ) == 0 && st.st_dev != parent ){
+      return true;
+    }
+    ::usleep( 10000 );
+  }
+  return false;
+}
+
+struct result {
+  double write_mbs;
+  double read_mbs;
+  double create_ops;
+  double stat_ops;
+  double read_ops;
+};
+
+static result workload( const std::string& mountpoint, size_t megabytes, size_t files ){
+  result r;
+  std::vector< char > block( 1024 * 1024, 'x' );
+  const std::string big = mountpoint + "/big";
+
+  double start = now();
+  int fd = ::open( big.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644 );
+  for( size_t i = 0; fd >= 0 && i < megabytes; ++i ){
+    if( ::write( fd, &block[0], block.size() ) < 0 ){
+      break;
+    }
+  }
+  ::close( fd );
+  r.write_mbs = megabytes / ( now() - start );
+
+  start = now();
+  fd = ::open( big.c_str(), O_RDONLY );
+  while( fd >= 0 && ::read( fd, &block[0], block.size() ) > 0 ){
+  }
+  ::close( fd );
+  r.read_mbs = megabytes / ( now() - start );
+
+  std::vector< std::string > names;
+  for( size_t i = 0; i < files; ++i ){
+    char name[32];
+    ::snprintf( name, sizeof(name), "/small-%06lu", static_cast< unsigned long >( i ) );
+    names.push_back( mountpoint + name );
+  }
+  start = now();
+  for( size_t i = 0; i < files; ++i ){
+    fd = ::open( names[i].c_str(), O_CREAT | O_WRONLY, 0644 );
+    if( fd >= 0 ){
+      ::write( fd, &block[0], 4096 );
+      ::close( fd );
+    }
+  }
+  r.create_ops = files / ( now() - start );
+
+  start = now();
+  for( int pass = 0; pass < 2; ++pass ){
+    for( size_t i = 0; i < files; ++i ){
+      struct stat st;
+      ::stat( names[i].c_str(), &st );
+    }
+  }
+  r.stat_ops = 2 * files / ( now() - start );
+
+  start = now();
+  for( size_t i = 0; i < files; ++i ){
+    fd = ::open( names[i].c_str(), O_RDONLY );
+    if( fd >= 0 ){
+      ::read( fd, &block[0], 4096 );
+      ::close( fd );
+    }
+  }
+  r.read_ops = files / ( now() - start );
+  return r;
+}
+
+int main( int argc, char* argv[] ){
+  if( argc < 2 ){
+    ::fprintf( stderr, "usage: %s mountpoint [megabytes] [files]\n", argv[0] );
+    return 1;
+  }
+  const std::string mountpoint( argv[1] );
+  const size_t megabytes = argc > 2 ? ::atoi( argv[2] ) : 256;
+  const size_t files = argc > 3 ? ::atoi( argv[3] ) : 2000;
+  struct stat parent;
+  if( ::stat( mountpoint.c_str(), &parent ) != 0 ){
+    ::perror( argv[1] );
+    return 1;
+  }
+
+  const char* names[] = { "defaults", "latency", "throughput" };
+  fusekit::mount_options presets[] = {
+    fusekit::mount_options::defaults(),
+    fusekit::mount_options::latency(),
+    fusekit::mount_options::throughput()
+  };
+
+  ::printf( "%-12s %10s %10s %12s %12s %12s\n", "preset", "write MB/s", "read MB/s", "create/s", "stat/s", "read/s" );
+  for( int p = 0; p < 3; ++p ){
+    bench_daemon daemon;
+    int err = 0;
+    std::thread server( [&]{ err = daemon.serve( mountpoint.c_str(), presets[p] ); } );
+    if( !mounted( mountpoint, parent.st_dev ) ){
+      ::fprintf( stderr, "%s: mount failed\n", names[p] );
+      daemon.exit();
+      server.join();
+      return 1;
+    }
+    const result r = workload( mountpoint, megabytes, files );
+    ::printf( "%-12s %10.1f %10.1f %12.0f %12.0f %12.0f\n", names[p], r.write_mbs, r.read_mbs, r.create_ops, r.stat_ops, r.read_ops );
+    daemon.exit();
+    server.join();
+    if( err ){
+      ::fprintf( stderr, "%s: %d\n", names[p], err );
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,155 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <thread>
+#include <fusekit/daemon.h>
+#include <fusekit/memory_file.h>
+#include <fusekit/mount_options.h>
+#include <fusekit/mutex_lock.h>
+
+/// example measures how the request loops scale with concurrent clients.
+///
+/// a directory of small memory files is mounted with each loop in turn:
+/// the multithreaded loop of fuse, worker threads sharing the device
+/// file, and cpu bound worker threads with a device file each (clone_fd).
+/// the clients stat and read the files for a while, caching is turned
+/// off so every operation reaches the daemon. the files are created
+/// through the mount and released asynchronously, so the daemon
+/// serializes the operations with mutex_lock: the loops differ in how
+/// the requests reach the daemon, not in how the tree is locked. fuse 3
+/// clones the device files in its own loop only, there the last loop is
+/// the loop of fuse with clone_fd.
+/// $scalability_benchmark mountpoint [clients] [seconds]
+typedef fusekit::default_directory<
+  fusekit::directory_factory<>,
+  fusekit::file_factory< fusekit::memory_file_creator >
+  >::type bench_directory;
+
+typedef fusekit::daemon< bench_directory, fusekit::mutex_lock > bench_daemon;
+
+static const size_t files = 256;
+
+static double now(){
+  struct timespec t;
+  clock_gettime( CLOCK_MONOTONIC, &t );
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/// waits until the file system is mounted over mountpoint.
+static bool mounted( const std::string& mountpoint, dev_t parent ){
+  for( int i = 0; i < 500; ++i ){
+    struct stat st;
+    if( ::stat( mountpoint.c_str(), &st ) == 0 && st.st_dev != parent ){
+      return true;
+    }
+    ::usleep( 10000 );
+  }
+  return false;
+}
+
+static std::string name( const std::string& mountpoint, size_t i ){
+  char n[32];
+  ::snprintf( n, sizeof(n), "/file-%04lu", static_cast< unsigned long >( i ) );
+  return mountpoint + n;
+}
+
+static void populate( const std::string& mountpoint ){
+  std::vector< char > block( 4096, 'x' );
+  for( size_t i = 0; i < files; ++i ){
+    const int fd = ::open( name( mountpoint, i ).c_str(), O_CREAT | O_WRONLY, 0644 );
+    if( fd >= 0 ){
+      ::write( fd, &block[0], block.size() );
+      ::close( fd );
+    }
+  }
+}
+
+/// operations per second of all clients.
+static double workload( const std::string& mountpoint, size_t clients, double seconds ){
+  std::atomic< unsigned long > operations( 0 );
+  const double end = now() + seconds;
+  std::vector< std::thread > threads;
+  for( size_t c = 0; c < clients; ++c ){
+    threads.push_back( std::thread( [&, c]{
+      std::vector< char > block( 4096 );
+      unsigned long done = 0;
+      for( size_t i = c; now() < end; i = ( i + 1 ) % files ){
+        const std::string path = name( mountpoint, i );
+        struct stat st;
+        ::stat( path.c_str(), &st );
+        const int fd = ::open( path.c_str(), O_RDONLY );
+        if( fd >= 0 ){
+          ::read( fd, &block[0], block.size() );
+          ::close( fd );
+        }
+        done += 4;
+      }
+      operations += done;
+    } ) );
+  }
+  for( size_t c = 0; c < clients; ++c ){
+    threads[c].join();
+  }
+  return operations / seconds;
+}
+
+int main( int argc, char* argv[] ){
+  if( argc < 2 ){
+    ::fprintf( stderr, "usage: %s mountpoint [clients] [seconds]\n", argv[0] );
+    return 1;
+  }
+  const std::string mountpoint( argv[1] );
+  const unsigned cpus = std::max( 1u, std::thread::hardware_concurrency() );
+  const size_t clients = argc > 2 ? ::atoi( argv[2] ) : 2 * cpus;
+  const double seconds = argc > 3 ? ::atof( argv[3] ) : 5;
+  struct stat parent;
+  if( ::stat( mountpoint.c_str(), &parent ) != 0 ){
+    ::perror( argv[1] );
+    return 1;
+  }
+
+  fusekit::mount_options uncached = fusekit::mount_options::defaults();
+  uncached.single_threaded = false;
+  uncached.entry_timeout = 0;
+  uncached.attr_timeout = 0;
+  uncached.negative_timeout = 0;
+
+  const char* names[] = { "fuse loop", "workers", "cloned" };
+  fusekit::mount_options loops[] = { uncached, uncached, uncached };
+  loops[1].threads = cpus;
+#if FUSE_USE_VERSION < 30
+  loops[2].threads = cpus;
+  loops[2].pin_threads = true;
+#endif
+  loops[2].clone_fd = true;
+
+  ::printf( "%lu clients, %u cpus\n", static_cast< unsigned long >( clients ), cpus );
+  ::printf( "%-12s %12s\n", "loop", "ops/s" );
+  for( int l = 0; l < 3; ++l ){
+    bench_daemon daemon;
+    int err = 0;
+    std::thread server( [&]{ err = daemon.serve( mountpoint.c_str(), loops[l] ); } );
+    if( !mounted( mountpoint, parent.st_dev ) ){
+      ::fprintf( stderr, "%s: mount failed\n", names[l] );
+      daemon.exit();
+      server.join();
+      return 1;
+    }
+    populate( mountpoint );
+    const double ops = workload( mountpoint, clients, seconds );
+    ::printf( "%-12s %12.0f\n", names[l], ops );
+    daemon.exit();
+    server.join();
+    if( err ){
+      ::fprintf( stderr, "%s: %d\n", names[l], err );
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,91 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <string>
+#include <thread>
+#include <fusekit/daemon.h>
+#include <fusekit/mutex_lock.h>
+#include <fusekit/shared_file.h>
+#include <fusekit/shared_reader.h>
+
+/// example publishes a generated file over a shared memory channel.
+///
+/// the daemon regenerates the file 'clock' ten times a second, from a
+/// thread of its own. it publishes under the lock of the daemon, which
+/// therefore serializes the operations with a mutex_lock. clients
+/// on the same host read it through the mount, or map it with a
+/// fusekit::shared_reader and read it without a request to the daemon.
+/// the client mode compares both:
+/// $shared_channel mountpoint
+/// $shared_channel --read mountpoint/clock [seconds]
+typedef fusekit::daemon< fusekit::default_directory<>::type, fusekit::mutex_lock > channel_daemon;
+
+static double now(){
+  struct timespec t;
+  clock_gettime( CLOCK_MONOTONIC, &t );
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static int client( const char* path, double seconds ){
+  std::vector< char > buf( 4096 );
+  long reads = 0;
+  double start = now();
+  while( now() - start < seconds ){
+    const int fd = ::open( path, O_RDONLY );
+    if( fd < 0 || ::read( fd, &buf[0], buf.size() ) < 0 ){
+      ::perror( path );
+      return 1;
+    }
+    ::close( fd );
+    ++reads;
+  }
+  ::printf( "mount:  %10.0f reads/s\n", reads / seconds );
+
+  fusekit::shared_reader reader;
+  const int err = reader.open( path );
+  if( err ){
+    ::fprintf( stderr, "%s: %s\n", path, ::strerror( -err ) );
+    return 1;
+  }
+  std::string content;
+  uint64_t version = 0;
+  long versions = 0;
+  reads = 0;
+  start = now();
+  while( now() - start < seconds ){
+    uint64_t seen = version;
+    if( reader.read( content, &version ) ){
+      return 1;
+    }
+    versions += version != seen;
+    ++reads;
+  }
+  ::printf( "shared: %10.0f reads/s, %ld versions seen\n", reads / seconds, versions );
+  return 0;
+}
+
+int main( int argc, char* argv[] ){
+  if( argc > 2 && ::strcmp( argv[1], "--read" ) == 0 ){
+    return client( argv[2], argc > 3 ? ::atof( argv[3] ) : 2 );
+  }
+  channel_daemon& daemon = channel_daemon::instance();
+  fusekit::shared_file<>::type* clock = fusekit::make_shared_file();
+  daemon.root().add_file( "clock", clock );
+  std::thread generator( [&daemon, clock]{
+      for( ;; ){
+        char line[64];
+        const time_t t = ::time( 0 );
+        ::strftime( line, sizeof(line), "%Y-%m-%d %H:%M:%S\n", ::localtime( &t ) );
+        {
+          channel_daemon::lock guard( daemon );
+          clock->publish( line, ::strlen( line ) );
+        }
+        ::usleep( 100000 );
+      }
+    } );
+  generator.detach();
+  return daemon.run( argc, argv );
+}
@@ -0,0 +1,64 @@
+#include <fusekit/daemon.h>
+#include <fusekit/static_directory.h>
+#include <fusekit/stream_callback_file.h>
+
+/// the names of the static tree
+FUSEKIT_STATIC_NAME( a, "a" );
+FUSEKIT_STATIC_NAME( b, "b" );
+FUSEKIT_STATIC_NAME( s, "s" );
+
+int root_s( std::ostream& os ){
+  os << "i am a child of /";
+  return 0;
+}
+
+int a_s( std::ostream& os ){
+  os << "i am a child of /a";
+  return 0;
+}
+
+int b_s( std::ostream& os ){
+  os << "i am a child of /b";
+  return 0;
+}
+
+/// children of a static directory are members and thus
+/// have to be default constructible.
+template< int (*Read)( std::ostream& ) >
+struct text_file : public fusekit::ostream_callback_file< int (*)( std::ostream& ) >::type {
+  text_file()
+    : fusekit::ostream_callback_file< int (*)( std::ostream& ) >::type( Read ){
+  }
+};
+
+typedef fusekit::static_directory< 
+  fusekit::static_entry< s, text_file< a_s > > 
+  >::type a_directory;
+
+typedef fusekit::static_directory< 
+  fusekit::static_entry< s, text_file< b_s > > 
+  >::type b_directory;
+
+typedef fusekit::static_directory< 
+  fusekit::static_entry< a, a_directory >,
+  fusekit::static_entry< b, b_directory >,
+  fusekit::static_entry< s, text_file< root_s > >
+  >::type root_directory;
+
+/// example demonstrates the same hierarchical structure as
+/// folders.cpp, but declared at compile time:
+/// mountpoint/s
+/// mountpoint/a/s
+/// mountpoint/b/s
+/// lookups of the names are resolved by tables computed at compile time
+/// and the entries are reachable with their concrete types by get<>().
+/// when started with like
+/// $staticfoldersfs mountpoint 
+int main( int argc, char* argv[] ){
+  fusekit::daemon< root_directory >& daemon = fusekit::daemon< root_directory >::instance();
+
+  // statically dispatched access to /a/s
+  daemon.root().get< a >().get< s >().chmod( 0440 );
+
+  return daemon.run(argc,argv);
+}
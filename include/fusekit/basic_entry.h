@@ -2,8 +2,11 @@
 #ifndef __FUSEKIT__BASIC_ENTRY_H
 #define __FUSEKIT__BASIC_ENTRY_H
 
+#include <string.h>
 #include <fusekit/entry.h>
+#include <fusekit/batch_runner.h>
 #include <fusekit/time_fields.h>
+#include <fusekit/change_log.h>
 
 namespace fusekit{
   
@@ -42,6 +45,7 @@ namespace fusekit{
       stbuf.st_mode = TypeFlag | base< PermissionPolicy >().mode();
       stbuf.st_nlink = base< NodePolicy >().links();
       stbuf.st_size = base< BufferPolicy >().size();
+      stbuf.st_blocks = base< BufferPolicy >().blocks();
       stbuf.st_ctim = base< TimePolicy >().change_time();
       stbuf.st_atim = base< TimePolicy >().access_time();
       stbuf.st_mtim = base< TimePolicy >().modification_time();
@@ -76,7 +80,7 @@ namespace fusekit{
       return base< NodePolicy >().opendir( fi );
     }
 
-    virtual int readdir( void *buf, fuse_fill_dir_t filler, off_t offset, fuse_file_info& fi ){
+    virtual int readdir( void *buf, fill_dir_t filler, off_t offset, fuse_file_info& fi ){
       return base< NodePolicy >().readdir( buf, filler, offset, fi );
     }
 
@@ -111,6 +115,7 @@ namespace fusekit{
     virtual int utimens( const timespec[2] ){
       // TODO: Changes to using the arguments
       base< TimePolicy >().update( fusekit::access_time | fusekit::modification_time );
+      change_log::instance().record( change_utimens );
       return 0;
     }
 
@@ -127,6 +132,9 @@ namespace fusekit{
     }
 
     virtual int getxattr( const char *name, char *value, size_t size ){
+      if( TypeFlag == S_IFDIR && ::strcmp( name, subtree_xattr ) == 0 ){
+        return base< NodePolicy >().subtree().format( value, size );
+      }
       return base< AttributesPolicy >().getxattr(name, value, size);
     }
 
@@ -137,6 +145,90 @@ namespace fusekit{
     virtual int removexattr( const char *name ){
       return base< AttributesPolicy >().removexattr(name);
     }
+
+    virtual int freeze( bool recursive ){
+      return base< NodePolicy >().freeze( recursive );
+    }
+
+    virtual int rename( const char* name, entry& newparent, const char* newname, unsigned int flags ){
+      return base< NodePolicy >().rename( name, newparent, newname, flags );
+    }
+
+    virtual int attach( const char* name, entry* child ){
+      return base< NodePolicy >().attach( name, child );
+    }
+
+    virtual entry* detach( const char* name ){
+      return base< NodePolicy >().detach( name );
+    }
+
+    virtual int link( const char* name, entry& target ){
+      return base< NodePolicy >().link( name, target );
+    }
+
+    virtual int hold(){
+      return base< NodePolicy >().hold();
+    }
+
+    virtual int drop(){
+      return base< NodePolicy >().drop();
+    }
+
+    virtual int scan( const std::string& prefix, child_visitor& visitor ){
+      return base< NodePolicy >().scan( prefix, visitor );
+    }
+
+    virtual subtree_size subtree(){
+      return base< NodePolicy >().subtree();
+    }
+
+    virtual subtree_size adopted( entry* parent ){
+      return base< NodePolicy >().adopted( parent );
+    }
+
+    virtual subtree_size orphaned( entry* parent ){
+      return base< NodePolicy >().orphaned( parent );
+    }
+
+    virtual void add_subtree( const subtree_size& delta ){
+      base< NodePolicy >().add_subtree( delta );
+    }
+
+    virtual unsigned long generation(){
+      return base< NodePolicy >().generation();
+    }
+
+    virtual off_t lseek( off_t offset, int whence, fuse_file_info& fi ){
+      return base< BufferPolicy >().lseek( offset, whence, fi );
+    }
+
+    virtual int fallocate( int mode, off_t offset, off_t length, fuse_file_info& fi ){
+      return base< BufferPolicy >().fallocate( mode, offset, length, fi );
+    }
+
+    virtual ssize_t copy_file_range( fuse_file_info& fi_in, off_t off_in, entry& out, fuse_file_info& fi_out, off_t off_out, size_t len, int flags ){
+      return base< BufferPolicy >().copy_file_range( fi_in, off_in, out, fi_out, off_out, len, flags );
+    }
+
+    virtual int fstat( struct stat& stbuf, fuse_file_info& ){
+      return stat( stbuf );
+    }
+
+    virtual int ftruncate( off_t off, fuse_file_info& ){
+      return truncate( off );
+    }
+
+    virtual int fchmod( mode_t permission, fuse_file_info& ){
+      return chmod( permission );
+    }
+
+    /// the batch ioctl of directories (see run_batch).
+    virtual int ioctl( unsigned int cmd, void* data, fuse_file_info& ){
+      if( TypeFlag == S_IFDIR && cmd == batch_ioctl ){
+        return run_batch( *this, static_cast< char* >( data ), _IOC_SIZE( cmd ) );
+      }
+      return -ENOTTY;
+    }
   };
 }
 
@@ -0,0 +1,166 @@
+
+#ifndef __FUSEKIT__BATCH_H
+#define __FUSEKIT__BATCH_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+
+namespace fusekit{
+
+  /// the layout of the batch ioctl of directories, shared by the daemon
+  /// (see run_batch) and the clients (see batch_client).
+  ///
+  /// the buffer of the ioctl holds a batch_request followed by names,
+  /// each terminated by a null: the attribute name for batch_xattr, then
+  /// the names of the children. the daemon replaces it by a batch_reply
+  /// followed by a batch_record per child. the size of an ioctl is
+  /// limited to 16 KiB by the kernel, so a batch answers as many
+  /// children as fit and tells where the next one continues.
+  enum {
+    batch_stat = 1,
+    batch_read = 2,
+    batch_xattr = 4,
+    batch_size = 16 * 1024 - 8
+  };
+
+  static const unsigned int batch_ioctl = _IOWR( 'F', 0x42, char[ batch_size ] );
+
+  struct batch_request {
+    /// batch_stat, batch_read and batch_xattr.
+    uint32_t operations;
+    /// the names following, 0 for all children of the directory in the
+    /// order of scan.
+    uint32_t count;
+    /// the position of the first child: the index of the first name in
+    /// the list of the client, or in the scan of all children.
+    uint32_t start;
+    /// the bytes read of each file at most.
+    uint32_t max_read;
+  };
+
+  struct batch_reply {
+    /// the records following.
+    uint32_t count;
+    /// the start of the next batch: start and the children answered.
+    uint32_t next;
+    /// true if children of the scan are left for the next batch.
+    uint32_t more;
+    uint32_t reserved;
+  };
+
+  /// the results of one child, followed by its name, the bytes read and
+  /// the value of the attribute.
+  struct batch_record {
+    /// the bytes of the record with name and data, a multiple of 8.
+    uint32_t size;
+    uint32_t name_size;
+    /// 0 or -errno.
+    int32_t stat_result;
+    /// the bytes read or -errno.
+    int32_t read_result;
+    /// the size of the attribute value or -errno.
+    int32_t xattr_result;
+    uint32_t reserved;
+    struct stat st;
+
+    const char* name() const {
+      return reinterpret_cast< const char* >( this + 1 );
+    }
+
+    const char* data() const {
+      return name() + name_size;
+    }
+
+    const char* value() const {
+      return data() + ( read_result > 0 ? read_result : 0 );
+    }
+  };
+
+  /// the client side of the batch ioctl: stat, small reads and getxattr
+  /// of many children of a directory in a request per 16 KiB of
+  /// results, instead of a few requests per child. needs no libfuse.
+  ///
+  ///   fusekit::batch_client::run( "/mnt/dir", fusekit::batch_stat | fusekit::batch_read, names, 4096, 0,
+  ///     []( const fusekit::batch_record& r ){ ... } );
+  ///
+  /// a directory which changes meanwhile may skip or repeat children if
+  /// all of them are requested (no names).
+  struct batch_client {
+    /// calls visitor( const batch_record& ) for every child. -errno on
+    /// failure, -ENOTTY if the directory has no batch ioctl.
+    template< class Visitor >
+    static int run( const char* directory, unsigned operations, const std::vector< std::string >& names,
+                    unsigned max_read, const char* xattr, Visitor visitor ){
+      const int fd = ::open( directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+      if( fd < 0 ){
+        return -errno;
+      }
+      std::vector< uint64_t > storage( batch_size / sizeof(uint64_t) );
+      char* buffer = reinterpret_cast< char* >( &storage[0] );
+      uint32_t start = 0;
+      for( ;; ){
+        batch_request* request = reinterpret_cast< batch_request* >( buffer );
+        request->operations = operations;
+        request->start = start;
+        request->max_read = max_read;
+        request->count = 0;
+        size_t used = sizeof(batch_request);
+        if( !append( buffer, used, operations & batch_xattr ? xattr : "" ) ){
+          ::close( fd );
+          return -ENAMETOOLONG;
+        }
+        // the names which fit, the daemon continues with the first one
+        for( size_t i = start; i < names.size() && append( buffer, used, names[i].c_str() ); ++i ){
+          ++request->count;
+        }
+        if( !names.empty() && !request->count ){
+          ::close( fd );
+          return -ENAMETOOLONG;
+        }
+        if( ::ioctl( fd, batch_ioctl, buffer ) < 0 ){
+          const int err = errno;
+          ::close( fd );
+          return -err;
+        }
+        const batch_reply* reply = reinterpret_cast< const batch_reply* >( buffer );
+        const char* record = buffer + sizeof(batch_reply);
+        for( uint32_t i = 0; i < reply->count; ++i ){
+          const batch_record& r = *reinterpret_cast< const batch_record* >( record );
+          visitor( r );
+          record += r.size;
+        }
+        start = reply->next;
+        const bool more = names.empty() ? reply->more : start < names.size();
+        if( !more || !reply->count ){
+          break;
+        }
+      }
+      ::close( fd );
+      return 0;
+    }
+
+  private:
+    static bool append( char* buffer, size_t& used, const char* name ){
+      const size_t size = ::strlen( name ) + 1;
+      if( used + size > batch_size ){
+        return false;
+      }
+      ::memcpy( buffer + used, name, size );
+      used += size;
+      return true;
+    }
+  };
+
+}
+
+#endif
+
+
+
@@ -0,0 +1,188 @@
+
+#ifndef __FUSEKIT__BATCH_RUNNER_H
+#define __FUSEKIT__BATCH_RUNNER_H
+
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fusekit/fuse.h>
+#include <fusekit/batch.h>
+#include <fusekit/entry.h>
+#include <fusekit/child_index.h>
+
+namespace fusekit{
+
+  /// the read permission of the caller of the request on a child with
+  /// the attributes st, checked like the kernel checks open and getxattr
+  /// with default_permissions: by the owner, the primary group and the
+  /// mode of the child. a child which leaves its owner to the uid and gid
+  /// mount options is owned by root here, so the check rather denies.
+  inline
+  int batch_may_read( const struct stat& st ){
+    const struct fuse_context* context = fuse_get_context();
+    if( !context || context->uid == 0 ){
+      return 0;
+    }
+    mode_t bit = S_IROTH;
+    if( context->uid == st.st_uid ){
+      bit = S_IRUSR;
+    }
+    else if( context->gid == st.st_gid ){
+      bit = S_IRGRP;
+    }
+    return st.st_mode & bit ? 0 : -EACCES;
+  }
+
+  /// answers the batch ioctl of directory (see batch.h) in buffer, which
+  /// holds size bytes. the stat results are those of entry::stat, reads
+  /// and attributes need the read permission of the caller (see
+  /// batch_may_read).
+  inline
+  int run_batch( entry& directory, char* buffer, size_t size ){
+    if( size < sizeof(batch_request) || size < sizeof(batch_reply) ){
+      return -EINVAL;
+    }
+    const batch_request request = *reinterpret_cast< const batch_request* >( buffer );
+
+    // the names are copied, the records overwrite them
+    std::vector< std::string > names;
+    const char* name = buffer + sizeof(batch_request);
+    const char* end = buffer + size;
+    for( uint32_t i = 0; i <= request.count; ++i ){
+      const char* terminator = static_cast< const char* >( ::memchr( name, 0, end - name ) );
+      if( !terminator ){
+        return -EINVAL;
+      }
+      names.push_back( std::string( name, terminator ) );
+      name = terminator + 1;
+    }
+    const std::string xattr = names[0];
+    names.erase( names.begin() );
+
+    typedef std::vector< std::pair< std::string, entry* > > children_t;
+    children_t children;
+    bool more = false;
+    if( request.count ){
+      for( size_t i = 0; i < names.size(); ++i ){
+        children.push_back( std::make_pair( names[i], directory.child( names[i].c_str() ) ) );
+      }
+    }
+    else{
+      struct collector : public child_visitor {
+        collector( children_t& c, uint32_t s, size_t l )
+          : children( c )
+          , position( 0 )
+          , start( s )
+          , limit( l )
+          , more( false ){
+        }
+        void operator()( const std::string& name, entry* e ){
+          if( position++ < start ){
+            return;
+          }
+          if( children.size() < limit ){
+            children.push_back( std::make_pair( name, e ) );
+          }
+          else{
+            more = true;
+          }
+        }
+        children_t& children;
+        uint32_t position;
+        uint32_t start;
+        size_t limit;
+        bool more;
+      } visitor( children, request.start, size / sizeof(batch_record) );
+      const int err = directory.scan( "", visitor );
+      if( err ){
+        return err;
+      }
+      more = visitor.more;
+    }
+
+    char* out = buffer + sizeof(batch_reply);
+    size_t left = ( size - sizeof(batch_reply) ) & ~size_t( 7 );
+    uint32_t answered = 0;
+    for( ; answered < children.size(); ++answered ){
+      const std::string& child = children[ answered ].first;
+      entry* e = children[ answered ].second;
+      const size_t fixed = sizeof(batch_record) + child.size() + 1;
+      if( fixed > left ){
+        break;
+      }
+      batch_record r;
+      ::memset( &r, 0, sizeof(r) );
+      r.name_size = child.size() + 1;
+      r.stat_result = e ? e->stat( r.st ) : -ENOENT;
+      r.read_result = r.xattr_result = e ? 0 : -ENOENT;
+      const int readable = r.stat_result ? r.stat_result : batch_may_read( r.st );
+      // a child which does not fit whole is left to the next batch, only
+      // the first one is cut to fit
+      size_t wanted = 0;
+      if( e && request.operations & batch_read && readable == 0 && S_ISREG( r.st.st_mode ) ){
+        wanted += std::min< size_t >( request.max_read, r.st.st_size );
+      }
+      if( e && request.operations & batch_xattr && readable == 0 ){
+        wanted += std::max( e->getxattr( xattr.c_str(), 0, 0 ), 0 );
+      }
+      if( answered && fixed + wanted > left ){
+        break;
+      }
+      char* data = out + fixed;
+      size_t room = left - fixed;
+      if( e && request.operations & batch_read ){
+        if( r.stat_result ){
+          r.read_result = r.stat_result;
+        }
+        else if( !S_ISREG( r.st.st_mode ) ){
+          r.read_result = S_ISDIR( r.st.st_mode ) ? -EISDIR : -EINVAL;
+        }
+        else if( ( r.read_result = readable ) == 0 ){
+          fuse_file_info fi;
+          ::memset( &fi, 0, sizeof(fi) );
+          fi.flags = O_RDONLY;
+          r.read_result = e->open( fi );
+          if( r.read_result == 0 ){
+            r.read_result = e->read( data, std::min< size_t >( request.max_read, room ), 0, fi );
+            e->release( fi );
+          }
+        }
+        if( r.read_result > 0 ){
+          data += r.read_result;
+          room -= r.read_result;
+        }
+      }
+      if( e && request.operations & batch_xattr ){
+        r.xattr_result = readable ? readable : e->getxattr( xattr.c_str(), 0, 0 );
+        if( r.xattr_result > 0 ){
+          r.xattr_result = static_cast< size_t >( r.xattr_result ) > room ? -ERANGE : e->getxattr( xattr.c_str(), data, room );
+        }
+      }
+      if( !( request.operations & batch_stat ) ){
+        ::memset( &r.st, 0, sizeof(r.st) );
+        r.stat_result = e ? 0 : -ENOENT;
+      }
+      r.size = ( fixed + ( r.read_result > 0 ? r.read_result : 0 ) + ( r.xattr_result > 0 ? r.xattr_result : 0 ) + 7 ) & ~7U;
+      ::memcpy( out, &r, sizeof(r) );
+      ::memcpy( out + sizeof(r), child.c_str(), child.size() + 1 );
+      out += r.size;
+      left -= r.size;
+    }
+
+    batch_reply* reply = reinterpret_cast< batch_reply* >( buffer );
+    reply->count = answered;
+    reply->next = request.start + answered;
+    reply->more = more || answered < children.size();
+    reply->reserved = 0;
+    return 0;
+  }
+
+}
+
+#endif
+
+
+
@@ -0,0 +1,179 @@
+
+#ifndef __FUSEKIT__CHANGE_FEED_H
+#define __FUSEKIT__CHANGE_FEED_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <fusekit/entry.h>
+#include <fusekit/file_handle.h>
+#include <fusekit/change_log.h>
+#include <fusekit/basic_file.h>
+
+namespace fusekit{
+
+  /// buffer policy of a file reading the change_log.
+  ///
+  /// every open file has a cursor, which starts before the oldest change
+  /// kept. a read returns the changes after the cursor as lines (see
+  /// change::format) and moves the cursor behind them, so repeated
+  /// reads return only the new changes and an empty read means there
+  /// are none. writing a sequence number moves the cursor behind it, so
+  /// a client resumes from its last position with:
+  ///
+  ///   echo 1234 >&3; cat <&3
+  ///
+  /// if changes after the cursor have been overwritten, the read starts
+  /// with a line "<sequence>\toverflow\t", telling the client to rescan.
+  ///
+  /// the feed reads the change_log of the daemon serving it. a disabled
+  /// log is enabled with the capacity of the feed when it is opened.
+  template<
+    class Derived
+    >
+  struct change_buffer {
+
+    change_buffer()
+      : _capacity( 4096 ){
+    }
+
+    void capacity( size_t capacity ){
+      _capacity = capacity;
+    }
+
+    struct file_handle : ::fusekit::file_handle {
+      file_handle()
+        : cursor( 0 ){
+      }
+      unsigned long long cursor;
+    };
+
+    int open( fuse_file_info& fi ){
+      change_log& log = change_log::instance();
+      if( !log.enabled() ){
+        log.set_capacity( _capacity );
+      }
+      fi.fh = reinterpret_cast< uint64_t >( new file_handle );
+      // the content depends on the cursor, not the offset
+      fi.direct_io = 1;
+      return 0;
+    }
+
+    int close( fuse_file_info& fi ){
+      if( fi.fh == 0 ){
+        return -EBADF;
+      }
+      delete reinterpret_cast< file_handle* >( fi.fh );
+      fi.fh = 0;
+      return 0;
+    }
+
+    int read( char* buf, size_t size, off_t, fuse_file_info& fi ){
+      if( fi.fh == 0 ){
+        return -EBADF;
+      }
+      file_handle* fh = reinterpret_cast< file_handle* >( fi.fh );
+      std::vector< change > changes;
+      const bool complete = change_log::instance().since( fh->cursor, changes, size / min_line + 1 );
+      unsigned long long cursor = fh->cursor;
+      std::string lines;
+      if( !complete && !changes.empty() ){
+        cursor = changes.front().sequence - 1;
+        char overflow[48];
+        ::snprintf( overflow, sizeof(overflow), "%llu\toverflow\t\n", cursor );
+        lines = overflow;
+      }
+      for( size_t i = 0; i < changes.size(); ++i ){
+        const std::string line = changes[i].format();
+        if( lines.size() + line.size() > size ){
+          break;
+        }
+        lines += line;
+        cursor = changes[i].sequence;
+      }
+      if( lines.size() > size || ( cursor == fh->cursor && !changes.empty() ) ){
+        // the next line does not fit into the buffer
+        return -EOVERFLOW;
+      }
+      fh->cursor = cursor;
+      std::copy( lines.begin(), lines.end(), buf );
+      return lines.size();
+    }
+
+    int write( const char* buf, size_t size, off_t, fuse_file_info& fi ){
+      if( fi.fh == 0 ){
+        return -EBADF;
+      }
+      const std::string number( buf, size );
+      char* end = 0;
+      const unsigned long long sequence = ::strtoull( number.c_str(), &end, 10 );
+      if( end == number.c_str() || ( *end && *end != '\n' ) ){
+        return -EINVAL;
+      }
+      reinterpret_cast< file_handle* >( fi.fh )->cursor = sequence;
+      return size;
+    }
+
+    int size(){
+      return 0;
+    }
+
+    int flush( fuse_file_info& fi ){
+      return fi.fh ? 0 : -EBADF;
+    }
+
+    int truncate( off_t ){
+      return 0;
+    }
+
+    int readlink( char*, size_t ){
+      return -EINVAL;
+    }
+
+    blkcnt_t blocks(){
+      return 0;
+    }
+
+    off_t lseek( off_t, int, fuse_file_info& ){
+      return -ENXIO;
+    }
+
+    int fallocate( int, off_t, off_t, fuse_file_info& ){
+      return -EOPNOTSUPP;
+    }
+
+    ssize_t copy_file_range( fuse_file_info&, off_t, entry&, fuse_file_info&, off_t, size_t, int ){
+      return -EOPNOTSUPP;
+    }
+
+  private:
+    /// the shortest line: "1\tadd\t\n".
+    static const size_t min_line = 7;
+
+    size_t _capacity;
+  };
+
+  typedef basic_file< change_buffer > change_feed;
+
+  /// a change feed to be added to the tree, which enables the change_log
+  /// with capacity changes if it is disabled. created in a daemon::scope,
+  /// the log of the daemon records from now on, else from the first open:
+  /// root.add_file( ".changes", make_change_feed() );
+  inline
+  change_feed* make_change_feed( size_t capacity = 4096 ){
+    if( !change_log::instance().enabled() ){
+      change_log::instance().set_capacity( capacity );
+    }
+    change_feed* feed = new change_feed;
+    feed->capacity( capacity );
+    return feed;
+  }
+
+}
+
+#endif
+
+
+
@@ -0,0 +1,246 @@
+
+#ifndef __FUSEKIT__CHANGE_LOG_H
+#define __FUSEKIT__CHANGE_LOG_H
+
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace fusekit{
+
+  enum change_kind {
+    change_create,
+    change_remove,
+    change_add,
+    change_rename,
+    change_link,
+    change_write,
+    change_truncate,
+    change_xattr,
+    change_chmod,
+    change_utimens,
+    change_exchange
+  };
+
+  /// a record of the change_log.
+  struct change {
+    unsigned long long sequence;
+    change_kind kind;
+    std::string path;
+    /// the new path of a rename, the other path of an exchange.
+    std::string target;
+
+    static const char* name( change_kind kind ){
+      static const char* const names[] = {
+        "create", "remove", "add", "rename", "link",
+        "write", "truncate", "xattr", "chmod", "utimens",
+        "exchange"
+      };
+      return names[ kind ];
+    }
+
+    /// the record as a line: sequence, kind, path and target separated
+    /// by tabs. tabs, newlines and backslashes in the paths are escaped.
+    std::string format() const {
+      char number[24];
+      ::snprintf( number, sizeof(number), "%llu", sequence );
+      std::string line( number );
+      line += '\t';
+      line += name( kind );
+      line += '\t';
+      escape( path, line );
+      if( kind == change_rename || kind == change_exchange ){
+        line += '\t';
+        escape( target, line );
+      }
+      line += '\n';
+      return line;
+    }
+
+  private:
+    static void escape( const std::string& s, std::string& line ){
+      for( size_t i = 0; i < s.size(); ++i ){
+        switch( s[i] ){
+        case '\\': line += "\\\\"; break;
+        case '\t': line += "\\t"; break;
+        case '\n': line += "\\n"; break;
+        default: line += s[i];
+        }
+      }
+    }
+  };
+
+  /// tree-wide log of the changes, for clients which synchronize
+  /// incrementally (see change_feed).
+  ///
+  /// the factories record creates, removes and added children, the
+  /// directories renames and links, memory backed and generic buffers
+  /// their writes and truncates, and the policies attribute changes.
+  /// the entries do not know their paths: the daemon announces the path
+  /// of the operation it runs as the origin, changes made by the
+  /// application outside of the daemon are logged with the name of the
+  /// child or an empty path.
+  ///
+  /// the log is a ring of the latest changes, with sequence numbers
+  /// starting at 1 and increasing by one, so reading the changes after
+  /// a sequence number costs O(changes). it is disabled until a capacity
+  /// is set, recording then costs one lock and the copy of the path.
+  ///
+  /// every daemon owns a log and makes it current in the threads running
+  /// its operations (see scope), so instance() is the log of the tree
+  /// being changed. outside of a scope, instance() is a process wide log.
+  struct change_log {
+
+    change_log()
+      : _enabled( false )
+      , _next( 1 ){
+    }
+
+    /// the current log of the thread.
+    static change_log& instance(){
+      static change_log l;
+      change_log* current = context().log;
+      return current ? *current : l;
+    }
+
+    /// keeps the latest capacity changes, 0 disables the log.
+    void set_capacity( size_t capacity ){
+      std::lock_guard< std::mutex > guard( _mutex );
+      std::vector< change > ring( capacity );
+      for( unsigned long long s = first(); capacity && s < _next; ++s ){
+        if( s + capacity >= _next ){
+          ring[ s % capacity ] = _ring[ s % _ring.size() ];
+        }
+      }
+      _ring.swap( ring );
+      _enabled.store( capacity != 0, std::memory_order_relaxed );
+    }
+
+    bool enabled() const {
+      return _enabled.load( std::memory_order_relaxed );
+    }
+
+    /// records a change of name (renamed to or exchanged with target),
+    /// which are replaced by the origin paths of the daemon if there are any.
+    void record( change_kind kind, const char* name = "", const char* target = "" ){
+      if( !enabled() || context().quiet ){
+        return;
+      }
+      const origin* o = context().current;
+      std::lock_guard< std::mutex > guard( _mutex );
+      if( _ring.empty() ){
+        return;
+      }
+      change& c = _ring[ _next % _ring.size() ];
+      c.sequence = _next++;
+      c.kind = kind;
+      c.path = o ? o->path : name;
+      c.target = o ? ( o->target ? o->target : "" ) : target;
+    }
+
+    /// the sequence number of the latest change, 0 if there is none.
+    unsigned long long last(){
+      std::lock_guard< std::mutex > guard( _mutex );
+      return _next - 1;
+    }
+
+    /// appends up to max changes after sequence to changes. returns false
+    /// if changes after sequence have been overwritten already, changes
+    /// starts with the oldest change kept then.
+    bool since( unsigned long long sequence, std::vector< change >& changes, size_t max ){
+      std::lock_guard< std::mutex > guard( _mutex );
+      const unsigned long long oldest = first();
+      const bool complete = sequence + 1 >= oldest;
+      unsigned long long s = complete ? sequence + 1 : oldest;
+      for( ; s < _next && max; ++s, --max ){
+        changes.push_back( _ring[ s % _ring.size() ] );
+      }
+      return complete;
+    }
+
+    /// the path of the operation the daemon runs in this thread, and
+    /// the new path of a rename.
+    struct origin {
+      explicit origin( const char* p, const char* t = 0 )
+        : path( p )
+        , target( t )
+        , _previous( context().current ){
+        context().current = this;
+      }
+
+      ~origin(){
+        context().current = _previous;
+      }
+
+      const char* path;
+      const char* target;
+
+    private:
+      origin( const origin& );
+      origin& operator=( const origin& );
+      const origin* _previous;
+    };
+
+    /// makes log the current log of this thread.
+    struct scope {
+      explicit scope( change_log& log )
+        : _previous( context().log ){
+        context().log = &log;
+      }
+
+      ~scope(){
+        context().log = _previous;
+      }
+
+    private:
+      scope( const scope& );
+      scope& operator=( const scope& );
+      change_log* _previous;
+    };
+
+    /// suppresses the records of this thread, e.g. the chmod of a
+    /// child which is being created.
+    struct quiet {
+      quiet(){
+        ++context().quiet;
+      }
+
+      ~quiet(){
+        --context().quiet;
+      }
+    };
+
+  private:
+    struct thread_context {
+      const origin* current;
+      int quiet;
+      change_log* log;
+    };
+
+    static thread_context& context(){
+      static thread_local thread_context c = { 0, 0, 0 };
+      return c;
+    }
+
+    /// the sequence number of the oldest change kept.
+    unsigned long long first() const {
+      return _next > _ring.size() ? _next - _ring.size() : 1;
+    }
+
+    change_log( const change_log& );
+    change_log& operator=( const change_log& );
+
+    std::atomic< bool > _enabled;
+    std::mutex _mutex;
+    std::vector< change > _ring;
+    unsigned long long _next;
+  };
+
+}
+
+#endif
+
+
+
@@ -0,0 +1,118 @@
+
+#ifndef __FUSEKIT__CHILD_INDEX_H
+#define __FUSEKIT__CHILD_INDEX_H
+
+#include <set>
+#include <string>
+#include <vector>
+#include <utility>
+#include <fusekit/entry.h>
+
+namespace fusekit{
+
+  /// names are copied out of the index, so they stay valid after the
+  /// index has been changed or has published a new version.
+  typedef std::set< std::string > name_container_t;
+
+  /// visitor collecting the names of all children of an index.
+  ///
+  /// indexes (see hashed_index or rcu_index) call the visitor
+  /// with the name and the entry of each child.
+  struct collect_names {
+    collect_names( name_container_t& names )
+      : _names( names ){
+    }
+
+    void operator()( const std::string& name, entry* ){
+      _names.insert( name );
+    }
+
+  private:
+    name_container_t& _names;
+  };
+
+  typedef std::vector< std::pair< std::string, entry* > > children_t;
+
+  /// visitor collecting the names and entries of all children.
+  ///
+  /// a name which has already been collected is skipped, so visiting
+  /// several indexes in lookup order keeps the child which is found first.
+  struct collect_children {
+    collect_children( children_t& children )
+      : _children( children ){
+    }
+
+    void operator()( const std::string& name, entry* e ){
+      if( _names.insert( name ).second ){
+        _children.push_back( std::make_pair( name, e ) );
+      }
+    }
+
+  private:
+    children_t& _children;
+    name_container_t _names;
+  };
+
+  /// visitor interface for scans through the entry interface (see entry::scan).
+  struct child_visitor {
+    virtual ~child_visitor(){
+    }
+    virtual void operator()( const std::string& name, entry* e ) = 0;
+  };
+
+  /// passes the children whose names start with prefix on to visitor.
+  template< class Visitor >
+  struct prefix_filter {
+    prefix_filter( const std::string& prefix, Visitor& visitor )
+      : _prefix( prefix )
+      , _visitor( visitor ){
+    }
+
+    void operator()( const std::string& name, entry* e ){
+      if( name.compare( 0, _prefix.size(), _prefix ) == 0 ){
+        _visitor( name, e );
+      }
+    }
+
+  private:
+    const std::string& _prefix;
+    Visitor& _visitor;
+  };
+
+  template< class Index, class Visitor >
+  auto visit_prefix( const Index& index, const std::string& prefix, Visitor& visitor, int )
+    -> decltype( index.visit_prefix( prefix, visitor ), void() ){
+    index.visit_prefix( prefix, visitor );
+  }
+
+  template< class Index, class Visitor >
+  void visit_prefix( const Index& index, const std::string& prefix, Visitor& visitor, long ){
+    prefix_filter< Visitor > filter( prefix, visitor );
+    index.visit( filter );
+  }
+
+  /// calls visitor( name, entry ) for the children of index whose names
+  /// start with prefix. indexes which provide visit_prefix (radix_index)
+  /// only visit the matching children, the others are filtered.
+  template< class Index, class Visitor >
+  void visit_prefix( const Index& index, const std::string& prefix, Visitor& visitor ){
+    visit_prefix( index, prefix, visitor, 0 );
+  }
+
+  /// visitor dropping the references to all children of an index (used
+  /// by factories on destruction, when the index is not read anymore).
+  /// children without further references are deleted.
+  struct delete_entries {
+    void operator()( const std::string&, entry* e ){
+      if( e->drop() == 0 ){
+        delete e;
+      }
+    }
+  };
+
+}
+
+#endif
+
+
+
@@ -2,28 +2,266 @@
 #ifndef __FUSEKIT__DAEMON_H_
 #define __FUSEKIT__DAEMON_H_
 
-#ifndef FUSE_USE_VERSION
-#pragma message "FUSE_USE_VERSION is not defined. setting FUSE_USE_VERSION=27"
-#define FUSE_USE_VERSION 27
-#endif
-
+#include <fcntl.h>
+#include <stdio.h>
 #include <unistd.h>
+#include <string.h>
+#include <sys/stat.h>
 #include <sys/types.h>
-#include <fuse/fuse.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <vector>
-#include <sstream>
 
+#include <fusekit/fuse.h>
 #include <fusekit/entry.h>
 #include <fusekit/file_handle.h>
 #include <fusekit/no_entry.h>
 #include <fusekit/no_lock.h>
 #include <fusekit/default_directory.h>
 #include <fusekit/path.h>
+#include <fusekit/usage.h>
+#include <fusekit/change_log.h>
+#include <fusekit/reclaim.h>
+#include <fusekit/snapshot_set.h>
+#include <fusekit/xattr_index.h>
+#include <fusekit/mount_options.h>
+#include <fusekit/worker_loop.h>
 
 namespace fusekit{
 
-  /// daemon singleton which implements the fuse_operations
-  /// interface and delegates the file operations to file hierarchy entries.
+  /// non-template base of the daemons, so that the file systems of
+  /// several daemons can be served by one process (see mount_group).
+  struct daemon_base {
+    daemon_base()
+      : _configured( false )
+      , _multithreaded( false )
+      , _fuse( 0 )
+      , _workers( 0 ){
+    }
+
+    virtual ~daemon_base(){
+    }
+
+#if FUSE_USE_VERSION > 26
+    /// mounts the file system at mountpoint with the options and serves
+    /// it until it is unmounted or exit is called. unlike run, serve
+    /// neither daemonizes nor installs signal handlers, so several file
+    /// systems can be served by the threads of a process. settings of
+    /// the worker threads the loop cannot honour give -EINVAL.
+    int serve( const char* mountpoint, const mount_options& options = mount_options::defaults() ){
+      const int invalid = loop_options( options );
+      if( invalid ){
+        return invalid;
+      }
+      _options = options;
+      _configured = true;
+      _multithreaded = !options.single_threaded;
+      mount_options mount = options;
+      // arguments of fuse_main, passed to the loop instead
+      mount.single_threaded = false;
+      mount.clone_fd = false;
+      mount.max_idle_threads = 0;
+      std::vector< std::string > arguments;
+      mount.append( arguments );
+      struct fuse_args args = FUSE_ARGS_INIT( 0, NULL );
+      fuse_opt_add_arg( &args, "fusekit" );
+      for( size_t i = 0; i < arguments.size(); ++i ){
+        fuse_opt_add_arg( &args, arguments[i].c_str() );
+      }
+#if FUSE_USE_VERSION >= 30
+      struct fuse* f = fuse_new( &args, &operations(), sizeof(fuse_operations), this );
+      fuse_opt_free_args( &args );
+      if( !f ){
+        return -EIO;
+      }
+      if( fuse_mount( f, mountpoint ) != 0 ){
+        fuse_destroy( f );
+        return -EIO;
+      }
+      attach( f, mountpoint );
+      const int err = loop( f, options );
+      attach( 0, "" );
+      fuse_unmount( f );
+      fuse_destroy( f );
+      return err;
+#else
+      struct fuse_chan* channel = fuse_mount( mountpoint, &args );
+      if( !channel ){
+        fuse_opt_free_args( &args );
+        return -EIO;
+      }
+      struct fuse* f = fuse_new( channel, &args, &operations(), sizeof(fuse_operations), this );
+      fuse_opt_free_args( &args );
+      if( !f ){
+        fuse_unmount( mountpoint, channel );
+        return -EIO;
+      }
+      attach( f, mountpoint );
+      const int err = loop( f, options );
+      attach( 0, "" );
+      fuse_unmount( mountpoint, channel );
+      fuse_destroy( f );
+      return err;
+#endif
+    }
+
+    /// stops serve. a worker_loop stops at once. the loop of fuse
+    /// notices the exit with the next request only, so exit sends it
+    /// one (see wake). it may be called by a handler as well.
+    void exit(){
+      std::lock_guard< std::mutex > guard( _mutex );
+      struct fuse* f = _fuse;
+      if( !f ){
+        return;
+      }
+      fuse_exit( f );
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(2, 9)
+      if( _workers ){
+        _workers->exit();
+        return;
+      }
+#endif
+      wake( _mountpoint );
+    }
+#endif
+
+  protected:
+    /// the operations, with the daemon as private data.
+    virtual const fuse_operations& operations() = 0;
+
+    /// the options of the current mount.
+    mount_options _options;
+    /// false if the daemon runs with the command line only, whose
+    /// options the init request must not override.
+    bool _configured;
+    /// true if the requests are served by several threads.
+    bool _multithreaded;
+    /// serializes the operations of a multithreaded loop, if the
+    /// LockingPolicy does not.
+    std::mutex _serial;
+
+  private:
+    daemon_base( const daemon_base& );
+    daemon_base& operator=( const daemon_base& );
+
+#if FUSE_USE_VERSION > 26
+    /// -EINVAL for settings of the worker threads no loop can honour:
+    /// worker threads before fuse 2.9, pin_threads without worker
+    /// threads, and worker threads with clone_fd on fuse 3, which keeps
+    /// the device files of its loop internal.
+    static int loop_options( const mount_options& options ){
+      if( options.single_threaded ){
+        return 0;
+      }
+      if( options.threads && FUSE_VERSION < FUSE_MAKE_VERSION(2, 9) ){
+        return -EINVAL;
+      }
+      if( options.pin_threads && !options.threads ){
+        return -EINVAL;
+      }
+      if( options.threads && options.clone_fd && FUSE_USE_VERSION >= 30 ){
+        return -EINVAL;
+      }
+      return 0;
+    }
+
+    /// the fuse and the mountpoint exit stops.
+    void attach( struct fuse* f, const std::string& mountpoint ){
+      std::lock_guard< std::mutex > guard( _mutex );
+      _fuse = f;
+      _mountpoint = mountpoint;
+    }
+
+    /// wakes the loop of fuse waiting for the next request, with the
+    /// lookup of a name which has never been looked up, so no cache of
+    /// the kernel answers it. the lookup is sent by a thread of its own,
+    /// which waits for the reply while the calling handler returns.
+    static void wake( const std::string& mountpoint ){
+      static std::atomic< unsigned long > serial( 0 );
+      char name[64];
+      ::snprintf( name, sizeof(name), "/.fusekit-exit-%ld-%lu", static_cast< long >( ::getpid() ), ++serial );
+      std::thread( &daemon_base::lookup, mountpoint + name ).detach();
+    }
+
+    static void lookup( const std::string& path ){
+      struct stat st;
+      ::stat( path.c_str(), &st );
+    }
+
+    int loop( struct fuse* f, const mount_options& options ){
+      if( options.single_threaded ){
+        return fuse_loop( f );
+      }
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(2, 9)
+      if( options.threads ){
+        worker_loop workers( f, options );
+        {
+          std::lock_guard< std::mutex > guard( _mutex );
+          _workers = &workers;
+        }
+        const int err = workers.run();
+        std::lock_guard< std::mutex > guard( _mutex );
+        _workers = 0;
+        return err;
+      }
+#endif
+#if FUSE_USE_VERSION >= 32
+      struct fuse_loop_config config;
+      config.clone_fd = options.clone_fd;
+      config.max_idle_threads = options.max_idle_threads ? options.max_idle_threads : 10;
+      return fuse_loop_mt( f, &config );
+#elif FUSE_USE_VERSION >= 30
+      return fuse_loop_mt( f, options.clone_fd );
+#else
+      return fuse_loop_mt( f );
+#endif
+    }
+#endif
+
+    /// the mount being served, guarded by _mutex.
+    struct fuse* _fuse;
+    std::string _mountpoint;
+    std::mutex _mutex;
+    worker_loop* _workers;
+  };
+
+  /// tells whether a LockingPolicy serializes the operations, which it
+  /// declares with a static const bool serializes = true (see mutex_lock).
+  /// call it with 0.
+  template< class LockingPolicy >
+  constexpr bool policy_serializes( decltype( &LockingPolicy::serializes ) ){
+    return LockingPolicy::serializes;
+  }
+
+  template< class LockingPolicy >
+  constexpr bool policy_serializes( ... ){
+    return false;
+  }
+
+  /// the function which deletes the objects dropped from the tree (see
+  /// reclaim), which a LockingPolicy declares as a static retire
+  /// (see rcu_lock). objects are deleted at once by default.
+  template< class LockingPolicy >
+  constexpr reclaim::retire_function policy_retire( decltype( &LockingPolicy::retire ) ){
+    return &LockingPolicy::retire;
+  }
+
+  template< class LockingPolicy >
+  constexpr reclaim::retire_function policy_retire( ... ){
+    return &reclaim::immediately;
+  }
+
+  /// daemon which implements the fuse_operations interface and delegates
+  /// the file operations to file hierarchy entries.
+  ///
+  /// every daemon serves its own tree. the handlers of the operations
+  /// find their daemon in the private data of the fuse context, so a
+  /// process may create several daemons and mount them at the same time,
+  /// e.g. with a mount_group. instance() is a default daemon for
+  /// processes with a single file system.
   ///
   /// all file operations are delegated to the respective file hierarchy
   /// element which implements the entry interface. for all methods (operation) 
@@ -35,18 +273,86 @@ namespace fusekit{
     class Root = typename fusekit::default_directory<>::type, 
     class LockingPolicy = fusekit::no_lock 
     >
-  struct daemon : public LockingPolicy {
+  struct daemon
+    : public daemon_base
+    , public LockingPolicy {
     static daemon& instance() {
       static daemon d;
       return d;
     }
 
-    typedef typename daemon< Root, LockingPolicy >::lock lock;
+    daemon()
+      : _subtree_in_stat( false )
+      , _init( 0 ){
+      ::memset( &_ops, 0, sizeof(_ops) );
+    }
+
+    /// makes the change_log, the xattr_index, the snapshot_set and the
+    /// reclamation of the daemon current in this thread. the handlers
+    /// run in a scope, the application enters one to build or change the
+    /// tree from its own threads.
+    struct scope {
+      explicit scope( daemon& d )
+        : _changes( d._changes )
+        , _xattrs( d._xattrs )
+        , _snapshots( d._snapshots )
+        , _reclaim( policy_retire< LockingPolicy >( 0 ) ){
+      }
+    private:
+      change_log::scope _changes;
+      xattr_index::scope _xattrs;
+      snapshot_set::scope _snapshots;
+      reclaim::scope _reclaim;
+    };
+
+    /// serializes the operations while several threads serve the
+    /// requests and the LockingPolicy does not serialize them itself.
+    struct serial_lock {
+      explicit serial_lock( daemon& d )
+        : _mutex( d._multithreaded && !policy_serializes< LockingPolicy >( 0 ) ? &d._serial : 0 ){
+        if( _mutex ){
+          _mutex->lock();
+        }
+      }
+      ~serial_lock(){
+        if( _mutex ){
+          _mutex->unlock();
+        }
+      }
+    private:
+      std::mutex* _mutex;
+    };
+
+    /// the lock of the LockingPolicy, taken inside the scope of the daemon.
+    struct lock
+      : public scope
+      , public serial_lock
+      , public LockingPolicy::lock {
+      explicit lock( daemon& d )
+        : scope( d )
+        , serial_lock( d )
+        , LockingPolicy::lock( d ){
+      }
+    };
 
     Root& root(){
       return _root;
     }
 
+    change_log& changes(){
+      return _changes;
+    }
+
+    xattr_index& xattrs(){
+      return _xattrs;
+    }
+
+    /// if on, directories report the bytes and blocks of their subtree
+    /// (see subtree_node) as st_size and st_blocks. off by default.
+    void subtree_in_stat( bool on ){
+      _subtree_in_stat.store( on, std::memory_order_relaxed );
+    }
+
     /// runs / starts / mounts the filesystem daemon and returns after
     /// filesystem has been unmounted.
     ///
@@ -55,39 +361,61 @@ namespace fusekit{
     /// handling of fuse is used, based on the mode flags given by
     /// the getattr call.
     /// technically default_options == true expands the given command line
-    /// (argc,argv) with "-s -o default_permissions".
+    /// (argc,argv) with mount_options::defaults(): "-s -o default_permissions"
+    /// and the uid and gid of the process.
     int run( int argc, char* argv[], bool default_options = true ){
-      std::vector< char* > argv_vec(argv,argv+argc);
       if( default_options ){
-	update_uid();
-	update_gid();
-	argv_vec.push_back(const_cast< char* >("-s"));
-	argv_vec.push_back(const_cast< char* >("-o"));
-	argv_vec.push_back(const_cast< char* >("default_permissions"));
-	argv_vec.push_back(const_cast< char* >("-o"));
-	argv_vec.push_back(const_cast< char* >(_uid.c_str()));
-	argv_vec.push_back(const_cast< char* >("-o"));
-	argv_vec.push_back(const_cast< char* >(_gid.c_str()));
+	return run( argc, argv, mount_options::defaults() );
       }
-#if FUSE_USE_VERSION > 26
-      return fuse_main( argv_vec.size(), &argv_vec[0], &_ops, NULL );
-#else
-      return fuse_main( argv_vec.size(), &argv_vec[0], &_ops );
-#endif
+      std::vector< char* > argv_vec(argv,argv+argc);
+      _options = mount_options();
+      _configured = false;
+      _multithreaded = std::find_if( argv + 1, argv + argc, single_threaded ) == argv + argc;
+      return start( argv_vec );
+    }
+
+    /// runs the filesystem daemon like run above, with the command line
+    /// expanded by the options (see mount_options for the presets).
+    int run( int argc, char* argv[], const mount_options& options ){
+      std::vector< std::string > arguments;
+      options.append( arguments );
+      std::vector< char* > argv_vec(argv,argv+argc);
+      for( size_t i = 0; i < arguments.size(); ++i ){
+	argv_vec.push_back(const_cast< char* >(arguments[i].c_str()));
+      }
+      _options = options;
+      _configured = true;
+      _multithreaded = !options.single_threaded && std::find_if( argv + 1, argv + argc, single_threaded ) == argv + argc;
+      return start( argv_vec );
     }
 
   protected:
+    static bool single_threaded( const char* argument ){
+      return ::strcmp( argument, "-s" ) == 0;
+    }
+
     /**
      * \brief Add handlers for global operations.
      * \remark Run before setting internal handlers.
      */
     virtual void extendOperations(fuse_operations &ops) {}
 
-  private:
+    int start( std::vector< char* >& argv_vec ){
+#if FUSE_USE_VERSION > 26
+      return fuse_main( argv_vec.size(), &argv_vec[0], &operations(), this );
+#else
+      return fuse_main( argv_vec.size(), &argv_vec[0], &operations() );
+#endif
+    }
 
-    daemon(){
+    const fuse_operations& operations(){
+      ::memset( &_ops, 0, sizeof(_ops) );
       extendOperations(_ops);
       _ops.getattr = daemon::getattr;
+#if FUSE_USE_VERSION > 24 && FUSE_USE_VERSION < 30
+      _ops.fgetattr = daemon::fgetattr;
+      _ops.ftruncate = daemon::ftruncate;
+#endif
       _ops.readlink = daemon::readlink;
       _ops.opendir = daemon::opendir;
       _ops.readdir = daemon::readdir;
@@ -103,11 +431,26 @@ namespace fusekit{
       _ops.mkdir = daemon::mkdir;
       _ops.rmdir = daemon::rmdir;
       _ops.symlink = daemon::symlink;
+      _ops.rename = daemon::rename;
+      _ops.link = daemon::link;
       _ops.flush = daemon::flush;
       _ops.setxattr = daemon::setxattr;
       _ops.getxattr = daemon::getxattr;
       _ops.listxattr = daemon::listxattr;
       _ops.removexattr = daemon::removexattr;
+      _ops.statfs = daemon::statfs;
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(2, 8)
+      _ops.ioctl = daemon::ioctl;
+#endif
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(2, 9)
+      _ops.fallocate = daemon::fallocate;
+#endif
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 4)
+      _ops.copy_file_range = daemon::copy_file_range;
+#endif
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 8)
+      _ops.lseek = daemon::lseek;
+#endif
 #if FUSE_USE_VERSION > 24
       _ops.access  = daemon::access;
 #endif
@@ -115,59 +458,141 @@ namespace fusekit{
       _ops.utimens = daemon::utimens;
 #else
       _ops.utime = daemon::utime;
+#endif
+#if FUSE_USE_VERSION > 26
+      _init = _ops.init;
+      _ops.init = daemon::init;
+#endif
+      return _ops;
+    }
+
+  private:
+    /// e is about to change its content or its attributes, the
+    /// snapshots keep its state (see snapshot_set).
+    static entry& changing( entry& e ){
+      snapshot_set::instance().preserve( e );
+      return e;
+    }
+
+    /// the daemon serving the current request.
+    static daemon& self(){
+#if FUSE_USE_VERSION > 26
+      return *static_cast< daemon* >( fuse_get_context()->private_data );
+#else
+      return instance();
 #endif
     }
 
+#if FUSE_USE_VERSION > 26
+    /// requests the capabilities the handlers rely on, whatever the options.
+    static void require( struct fuse_conn_info& conn ){
+#ifdef FUSE_CAP_IOCTL_DIR
+      // the batch ioctl of directories, which fuse rejects with ENOTTY
+      // unless it is wanted
+      if( conn.capable & FUSE_CAP_IOCTL_DIR ){
+        conn.want |= FUSE_CAP_IOCTL_DIR;
+      }
+#endif
+    }
+#endif
+
+#if FUSE_USE_VERSION >= 30
+    /// applies the mount options, if run or serve got any, and keeps the
+    /// daemon as private data, after running the init handler added by
+    /// extendOperations.
+    static void* init( struct fuse_conn_info* conn, struct fuse_config* config ){
+      daemon& d = self();
+      if( d._configured ){
+        d._options.apply( *conn, *config );
+      }
+      require( *conn );
+      if( d._init ){
+        d._init( conn, config );
+      }
+      return &d;
+    }
+#elif FUSE_USE_VERSION > 26
+    /// applies the mount options, if run or serve got any, and keeps the
+    /// daemon as private data, after running the init handler added by
+    /// extendOperations.
+    static void* init( struct fuse_conn_info* conn ){
+      daemon& d = self();
+      if( d._configured ){
+        d._options.apply( *conn );
+      }
+      require( *conn );
+      if( d._init ){
+        d._init( conn );
+      }
+      return &d;
+    }
+#endif
+
     static int unlink( const char* p ){
-      lock guard(instance());
+      lock guard(self());
+      change_log::origin origin(p);
       path parent(p);
       const std::string to_delete = parent.back();
       parent.pop_back();
-      return instance().find_entry(parent).unlink(to_delete.c_str());
+      return self().find_entry(parent).unlink(to_delete.c_str());
     }
 
     static int mknod( const char* p, mode_t m, dev_t t ){
-      lock guard(instance());
+      lock guard(self());
+      change_log::origin origin(p);
       path parent(p);
       const std::string to_create = parent.back();
       parent.pop_back();
-      return instance().find_entry(parent).mknod(to_create.c_str(), m, t);
+      return self().find_entry(parent).mknod(to_create.c_str(), m, t);
     }
 
     static int mkdir( const char* p, mode_t m ){
-      lock guard(instance());
+      lock guard(self());
+      change_log::origin origin(p);
       path parent(p);
       const std::string to_create = parent.back();
       parent.pop_back();
-      return instance().find_entry(parent).mkdir(to_create.c_str(), m);
+      return self().find_entry(parent).mkdir(to_create.c_str(), m);
     }
 
     static int rmdir( const char* p ){
-      lock guard(instance());
+      lock guard(self());
+      change_log::origin origin(p);
       path parent(p);
       const std::string to_create = parent.back();
       parent.pop_back();
-      return instance().find_entry(parent).rmdir(to_create.c_str());
+      return self().find_entry(parent).rmdir(to_create.c_str());
     }
 
     static int access( const char* path, int perm ){
-      lock guard(instance());
-      return instance().find_entry(path).access(perm);
+      lock guard(self());
+      return self().find_entry(path).access(perm);
     }
 
+#if FUSE_USE_VERSION >= 30
+    static int chmod( const char* path, mode_t perm, struct fuse_file_info* fi ){
+      lock guard(self());
+      change_log::origin origin(path);
+      entry& e = changing(self().find_entry(path));
+      return fi ? e.fchmod(perm, *fi) : e.chmod(perm);
+    }
+#else
     static int chmod( const char* path, mode_t perm ){
-      lock guard(instance());
-      return instance().find_entry(path).chmod(perm);
+      lock guard(self());
+      change_log::origin origin(path);
+      return changing(self().find_entry(path)).chmod(perm);
     }
+#endif
 
     static int open( const char* path, struct fuse_file_info* fi ){
-      lock guard(instance());
-      return instance().find_entry(path).open(*fi);
+      lock guard(self());
+      entry& e = self().find_entry(path);
+      return ( fi->flags & O_TRUNC ? changing(e) : e ).open(*fi);
     }
 
     static int release( const char* path, struct fuse_file_info* fi ){
-      lock guard(instance());
-      int err = instance().find_entry(path).release(*fi);
+      lock guard(self());
+      int err = self().find_entry(path).release(*fi);
       if( err == -ENOENT && fi->fh ){
 	// close has been called on a file, which is no more 
 	delete reinterpret_cast< file_handle* >(fi->fh);
@@ -177,89 +602,260 @@ namespace fusekit{
     }
 
     static int flush( const char* path, struct fuse_file_info* fi ){
-      lock guard(instance());
-      return instance().find_entry(path).flush(*fi);
+      lock guard(self());
+      return self().find_entry(path).flush(*fi);
     }
 
+#if FUSE_USE_VERSION >= 30
+    static int truncate( const char* path, off_t offset, struct fuse_file_info* fi ){
+      lock guard(self());
+      change_log::origin origin(path);
+      entry& e = changing(self().find_entry(path));
+      return fi ? e.ftruncate( offset, *fi ) : e.truncate( offset );
+    }
+#else
     static int truncate( const char* path, off_t offset ){
-      lock guard(instance());
-      return instance().find_entry(path).truncate( offset );
+      lock guard(self());
+      change_log::origin origin(path);
+      return changing(self().find_entry(path)).truncate( offset );
     }
 
+    static int ftruncate( const char* path, off_t offset, struct fuse_file_info* fi ){
+      lock guard(self());
+      change_log::origin origin(path);
+      return changing(self().find_entry(path)).ftruncate( offset, *fi );
+    }
+#endif
+
+    /// answered from the counters of usage and the subtree totals of
+    /// the root, without a lock or a tree walk.
+    static int statfs( const char*, struct statvfs* st ){
+      return usage::instance().statfs(*st, self()._root.subtree().entries + 1);
+    }
+
+#if FUSE_USE_VERSION >= 30
+    static int getattr( const char* path, struct stat* stbuf, struct fuse_file_info* fi ){
+      lock guard(self());
+      entry& e = self().find_entry(path);
+      return self().subtree_stat(e, fi ? e.fstat(*stbuf, *fi) : e.stat(*stbuf), *stbuf);
+    }
+#else
     static int getattr( const char* path, struct stat* stbuf ){
-      lock guard(instance());
-      return instance().find_entry(path).stat(*stbuf);
+      lock guard(self());
+      entry& e = self().find_entry(path);
+      return self().subtree_stat(e, e.stat(*stbuf), *stbuf);
+    }
+
+    static int fgetattr( const char* path, struct stat* stbuf, struct fuse_file_info* fi ){
+      lock guard(self());
+      entry& e = self().find_entry(path);
+      return self().subtree_stat(e, e.fstat(*stbuf, *fi), *stbuf);
+    }
+#endif
+
+    /// replaces st_size and st_blocks of a directory by the totals of
+    /// its subtree, if subtree_in_stat is on. passes err on.
+    int subtree_stat( entry& e, int err, struct stat& st ){
+      if( err == 0 && S_ISDIR( st.st_mode ) && _subtree_in_stat.load( std::memory_order_relaxed ) ){
+        const subtree_size s = e.subtree();
+        st.st_size = s.bytes;
+        st.st_blocks = s.blocks;
+      }
+      return err;
     }
 
     static int read( const char* path, char* buf, size_t size, off_t offset, struct fuse_file_info* fi ){
-      lock guard(instance());
-      return instance().find_entry(path).read(buf,size,offset,*fi);
+      lock guard(self());
+      return self().find_entry(path).read(buf,size,offset,*fi);
     }
 
     static int write( const char* path, const char* src, size_t size, off_t offset, struct fuse_file_info* fi ){
-      lock guard(instance());
-      return instance().find_entry(path).write(src,size,offset,*fi);
+      lock guard(self());
+      change_log::origin origin(path);
+      return changing(self().find_entry(path)).write(src,size,offset,*fi);
     }
 
     static int opendir( const char *path, struct fuse_file_info *fi ){
-      lock guard(instance());
-      return instance().find_entry(path).opendir(*fi);
+      lock guard(self());
+      return self().find_entry(path).opendir(*fi);
     }
 
-    static int readdir( const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi ){
-      lock guard(instance());
-      return instance().find_entry(path).readdir(buf,filler,offset,*fi);
+#if FUSE_USE_VERSION >= 30
+    /// passes the names of entry::readdir on to the filler of fuse 3,
+    /// for readdirplus with the attributes of the children.
+    struct directory_filler {
+      void* buf;
+      fuse_fill_dir_t filler;
+      entry* directory;
+      bool plus;
+
+      static int fill( void* context, const char* name, const struct stat* stbuf, off_t offset ){
+	directory_filler& f = *static_cast< directory_filler* >( context );
+	struct stat st;
+	if( f.plus && !stbuf && ::strcmp( name, "." ) != 0 && ::strcmp( name, ".." ) != 0 ){
+	  entry* child = f.directory->child( name );
+	  ::memset( &st, 0, sizeof(st) );
+	  if( child && self().subtree_stat( *child, child->stat( st ), st ) == 0 ){
+	    stbuf = &st;
+	  }
+	}
+	const fuse_fill_dir_flags flags = stbuf ? FUSE_FILL_DIR_PLUS : static_cast< fuse_fill_dir_flags >( 0 );
+	return f.filler( f.buf, name, stbuf, offset, flags );
+      }
+    };
+
+    static int readdir( const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags ){
+      lock guard(self());
+      entry& e = self().find_entry(path);
+      directory_filler f = { buf, filler, &e, ( flags & FUSE_READDIR_PLUS ) != 0 };
+      return e.readdir(&f,directory_filler::fill,offset,*fi);
+    }
+#else
+    static int readdir( const char *path, void *buf, fill_dir_t filler, off_t offset, struct fuse_file_info *fi ){
+      lock guard(self());
+      return self().find_entry(path).readdir(buf,filler,offset,*fi);
     }
+#endif
 
     static int releasedir( const char *path, struct fuse_file_info *fi ){
-      lock guard(instance());
-      return instance().find_entry(path).releasedir(*fi);
+      lock guard(self());
+      return self().find_entry(path).releasedir(*fi);
     }
 
+#if FUSE_USE_VERSION < 26
     static int utime( const char *path, utimbuf* buf ){
-      lock guard(instance());
+      lock guard(self());
+      change_log::origin origin(path);
       struct timespec tv[2] = { 0 };
       tv[0].tv_sec = buf->actime;
       tv[1].tv_sec = buf->modtime;
-      return instance().find_entry(path).utimens(tv);
+      return changing(self().find_entry(path)).utimens(tv);
     }
+#endif
 
+#if FUSE_USE_VERSION >= 30
+    static int utimens( const char *path, const struct timespec tv[2], struct fuse_file_info* ){
+      lock guard(self());
+      change_log::origin origin(path);
+      return changing(self().find_entry(path)).utimens(tv);
+    }
+#else
     static int utimens( const char *path, const struct timespec tv[2] ){
-      lock guard(instance());
-      return instance().find_entry(path).utimens(tv);
+      lock guard(self());
+      change_log::origin origin(path);
+      return changing(self().find_entry(path)).utimens(tv);
     }
+#endif
 
     static int readlink( const char *path, char *buffer, size_t size ){
-      lock guard(instance());
-      return instance().find_entry(path).readlink(buffer, size);
+      lock guard(self());
+      return self().find_entry(path).readlink(buffer, size);
     }
 
     static int symlink( const char *path, const char* target ){
-      lock guard(instance());
+      lock guard(self());
+      change_log::origin origin(path);
       struct path pa = path;
       const std::string name = pa.back();
       pa.pop_back();
-      return instance().find_entry(pa).symlink(name.c_str(), target);
+      return self().find_entry(pa).symlink(name.c_str(), target);
+    }
+
+#if FUSE_USE_VERSION >= 30
+    static int rename( const char *from, const char *to, unsigned int flags ){
+      lock guard(self());
+      change_log::origin origin(from, to);
+      return self().rename_entry(from, to, flags);
+    }
+#else
+    static int rename( const char *from, const char *to ){
+      lock guard(self());
+      change_log::origin origin(from, to);
+      return self().rename_entry(from, to, 0);
+    }
+#endif
+
+    static int link( const char *from, const char *to ){
+      lock guard(self());
+      change_log::origin origin(to);
+      struct path pa = to;
+      const std::string name = pa.back();
+      pa.pop_back();
+      return self().find_entry(pa).link(name.c_str(), self().find_entry(from));
     }
 
     static int setxattr( const char *path, const char *name, const char *value, size_t size, int flags ){
-      lock guard(instance());
-      return instance().find_entry(path).setxattr(name, value, size, flags);
+      lock guard(self());
+      change_log::origin origin(path);
+      return changing(self().find_entry(path)).setxattr(name, value, size, flags);
     }
 
     static int getxattr( const char *path, const char *name, char *value, size_t size ){
-      lock guard(instance());
-      return instance().find_entry(path).getxattr(name, value, size);
+      lock guard(self());
+      return self().find_entry(path).getxattr(name, value, size);
     }
 
     static int listxattr( const char *path, char *list, size_t size ){
-      lock guard(instance());
-      return instance().find_entry(path).listxattr(list, size);
+      lock guard(self());
+      return self().find_entry(path).listxattr(list, size);
     }
 
     static int removexattr( const char *path, const char *name ){
-      lock guard(instance());
-      return instance().find_entry(path).removexattr(name);
+      lock guard(self());
+      change_log::origin origin(path);
+      return changing(self().find_entry(path)).removexattr(name);
+    }
+
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(2, 8)
+    static int ioctl( const char* path, ioctl_cmd_t cmd, void*, struct fuse_file_info* fi, unsigned int, void* data ){
+      lock guard(self());
+      return self().find_entry(path).ioctl(cmd, data, *fi);
+    }
+#endif
+
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(2, 9)
+    static int fallocate( const char* path, int mode, off_t offset, off_t length, struct fuse_file_info* fi ){
+      lock guard(self());
+      change_log::origin origin(path);
+      return changing(self().find_entry(path)).fallocate(mode, offset, length, *fi);
+    }
+#endif
+
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 4)
+    static ssize_t copy_file_range( const char* path_in, struct fuse_file_info* fi_in, off_t off_in,
+                                    const char* path_out, struct fuse_file_info* fi_out, off_t off_out,
+                                    size_t size, int flags ){
+      lock guard(self());
+      change_log::origin origin(path_out);
+      return self().find_entry(path_in).copy_file_range(*fi_in, off_in, changing(self().find_entry(path_out)), *fi_out, off_out, size, flags);
+    }
+#endif
+
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 8)
+    static off_t lseek( const char* path, off_t offset, int whence, struct fuse_file_info* fi ){
+      lock guard(self());
+      return self().find_entry(path).lseek(offset, whence, *fi);
+    }
+#endif
+
+    int rename_entry( const char* from, const char* to, unsigned int flags ){
+      // a directory cannot become a descendant of itself, neither by a
+      // move nor by exchanging it with one of its descendants
+      if( descendant(to, from) || ( flags & RENAME_EXCHANGE && descendant(from, to) ) ){
+	return -EINVAL;
+      }
+      path source(from);
+      const std::string name = source.back();
+      source.pop_back();
+      path target(to);
+      const std::string newname = target.back();
+      target.pop_back();
+      return find_entry(source).rename(name.c_str(), find_entry(target), newname.c_str(), flags);
+    }
+
+    static bool descendant( const char* p, const char* ancestor ){
+      const std::string prefix = std::string(ancestor) + "/";
+      return std::string(p).compare(0, prefix.size(), prefix) == 0;
     }
 
     fusekit::entry& find_entry( const path& pa ){
@@ -278,24 +874,18 @@ namespace fusekit{
       return *e;
     }   
 
-    void update_uid(){
-      _uid = "uid=";
-      std::ostringstream uid_stream;
-      uid_stream << ::getuid();
-      _uid += uid_stream.str();
-    }
-
-    void update_gid(){
-      _gid = "gid=";
-      std::ostringstream gid_stream;
-      gid_stream << ::getgid();
-      _gid += gid_stream.str();
-    }
-    
+    // constructed before the root, destroyed after it
+    change_log _changes;
+    xattr_index _xattrs;
+    snapshot_set _snapshots;
+    std::atomic< bool > _subtree_in_stat;
     Root _root;
     fuse_operations _ops;
-    std::string _uid;
-    std::string _gid;
+#if FUSE_USE_VERSION >= 30
+    void* (*_init)( struct fuse_conn_info*, struct fuse_config* );
+#else
+    void* (*_init)( struct fuse_conn_info* );
+#endif
   };
 }
 
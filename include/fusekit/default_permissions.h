@@ -3,6 +3,7 @@
 #define __FUSEKIT__DEFAULT_PERMISSIONS_H
 
 #include <fusekit/entry.h>
+#include <fusekit/change_log.h>
 
 namespace fusekit{
 
@@ -25,6 +26,7 @@ namespace fusekit{
     int chmod( mode_t permissions ){
       static_cast< Derived* >(this)->update(fusekit::modification_time);
       _current = permissions;
+      change_log::instance().record( change_chmod );
       return 0;
     }
 
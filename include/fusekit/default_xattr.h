@@ -6,6 +6,7 @@
 #include <map>
 #include <vector>
 #include <array>
+#include <fusekit/change_log.h>
 
 namespace fusekit{
 
@@ -24,6 +25,7 @@ namespace fusekit{
       }
       _attributes[key].clear();
       _attributes[key].assign(value, value + size);
+      change_log::instance().record( change_xattr );
       return 0;
     }
     int getxattr( const char *name, char *value, size_t size ){
@@ -65,6 +67,7 @@ namespace fusekit{
         return -ENODATA;
       }
       _attributes.erase(element);
+      change_log::instance().record( change_xattr );
       return 0;
     }
   private:
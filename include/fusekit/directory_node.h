@@ -3,14 +3,28 @@
 #define __FUSEKIT__DIRECTORY_NODE_H
 
 #include <time.h>
-#include <set>
+#include <string.h>
+#include <sys/stat.h>
+#include <atomic>
 #include <fusekit/entry.h>
+#include <fusekit/child_index.h>
+#include <fusekit/perfect_hash_index.h>
 #include <fusekit/time_fields.h>
+#include <fusekit/usage.h>
+#include <fusekit/subtree.h>
+#include <fusekit/change_log.h>
+#include <fusekit/reclaim.h>
+#include <fusekit/snapshot_set.h>
+
+#ifndef RENAME_NOREPLACE
+#define RENAME_NOREPLACE (1 << 0)
+#endif
+#ifndef RENAME_EXCHANGE
+#define RENAME_EXCHANGE (1 << 1)
+#endif
 
 namespace fusekit{
 
-  typedef std::set< const char* > name_container_t;
- 
   template<
     class DirectoryFactory,
     class FileFactory,
@@ -21,8 +35,29 @@ namespace fusekit{
     : public DirectoryFactory
     , public FileFactory
     , public SymlinkFactory {
+
+    directory_node()
+      : _frozen( 0 )
+      , _generation( 1 )
+      , _subtree( subtree_size( 1 ) ){
+      usage::instance().add_directories( 1 );
+    }
+
+    ~directory_node(){
+      usage::instance().add_directories( -1 );
+      // hard linked children may survive the directory
+      orphan_children orphans( self() );
+      directory_factory().visit( orphans );
+      file_factory().visit( orphans );
+      symlink_factory().visit( orphans );
+      delete _frozen.load( std::memory_order_acquire );
+    }
     
     entry* find( const char* name ) {
+      perfect_hash_index* index = _frozen.load( std::memory_order_acquire );
+      if( index ) {
+        return index->find(name);
+      }
       entry* e = directory_factory().find(name);
       if( !e ) {
         e = file_factory().find(name);
@@ -41,26 +76,26 @@ namespace fusekit{
       return 0;
     }
 
-    int readdir( void* buf, fuse_fill_dir_t filler, off_t offset, fuse_file_info& ){
+    int readdir( void* buf, fill_dir_t filler, off_t offset, fuse_file_info& ){
       using namespace std;
       filler( buf, ".", NULL, offset );
       filler( buf, "..", NULL, offset );
       name_container_t names( file_factory().names() );
       name_container_t::const_iterator i = names.begin();
       while( i != names.end() ) {
-        filler( buf, *i, NULL, offset );
+        filler( buf, i->c_str(), NULL, offset );
         ++i;
       }
       names = symlink_factory().names();
       i = names.begin();
       while( i != names.end() ) {
-        filler( buf, *i, NULL, offset );
+        filler( buf, i->c_str(), NULL, offset );
         ++i;
       }
       names = directory_factory().names();
       i = names.begin();
       while( i != names.end() ) {
-        filler( buf, *i, NULL, offset );
+        filler( buf, i->c_str(), NULL, offset );
         ++i;
       }
       return 0;
@@ -71,14 +106,25 @@ namespace fusekit{
     }
 
     int mknod( const char* name, mode_t mode, dev_t type){
+      if( frozen() ){
+        return -EROFS;
+      }
+      preserve_children();
       const int err = file_factory().create(name,mode,type);
       if( err == 0 ){
+        created( file_factory().find(name) );
         update_change_and_modification_time();
       }
       return err;
     }
 
     int unlink( const char* name ){
+      if( frozen() ){
+        return -EROFS;
+      }
+      preserve_children();
+      removed( file_factory().find(name) );
+      orphan( file_factory().find(name) );
       const int err = file_factory().destroy(name);
       if( err == 0 ){
         update_change_and_modification_time();
@@ -87,14 +133,25 @@ namespace fusekit{
     }
 
     int mkdir( const char* name, mode_t mode ){
+      if( frozen() ){
+        return -EROFS;
+      }
+      preserve_children();
       const int err = directory_factory().create(name,mode);
       if( err == 0 ){
+        created( directory_factory().find(name) );
         update_change_and_modification_time();
       }
       return err;
     }
 
     int rmdir( const char* name ){
+      if( frozen() ){
+        return -EROFS;
+      }
+      preserve_children();
+      removed( directory_factory().find(name) );
+      orphan( directory_factory().find(name) );
       const int err = directory_factory().destroy(name);
       if( err == 0 ){
         update_change_and_modification_time();
@@ -103,17 +160,406 @@ namespace fusekit{
     }
 
     int symlink( const char* name, const char* target ){
+      if( frozen() ){
+        return -EROFS;
+      }
       if( find(name) != NULL ){
         return -EEXIST;
       }
+      preserve_children();
       const int err = symlink_factory().create(name,target);
       if( err == 0 ){
+        created( symlink_factory().find(name) );
+        update_change_and_modification_time();
+      }
+      return err;
+    }
+
+    /// moves the child name to newname of newparent (which may be this
+    /// directory) by moving the entry pointer, the content is never copied.
+    ///
+    /// an existing target is replaced in a single step, so newname
+    /// refers either to the old or to the new entry at any time. flags
+    /// may be RENAME_NOREPLACE or RENAME_EXCHANGE as for renameat2(2).
+    /// the entry is attached under newname before it is detached from
+    /// name, so it is reachable under one of the names at any time. the
+    /// daemon rejects moving a directory into itself.
+    int rename( const char* name, entry& newparent, const char* newname, unsigned int flags ){
+      int err;
+      {
+        // the removal of a replaced target is part of the rename
+        change_log::quiet renaming;
+        err = move( name, newparent, newname, flags );
+      }
+      if( err == 0 ){
+        change_log::instance().record( flags & RENAME_EXCHANGE ? change_exchange : change_rename, name, newname );
+      }
+      return err;
+    }
+
+    /// adds child to the factory matching its type. a child with the
+    /// same name is replaced (and deleted).
+    int attach( const char* name, entry* child ){
+      if( frozen() ){
+        return -EROFS;
+      }
+      entry* replaced = find( name );
+      if( replaced == child ){
+        return 0;
+      }
+      preserve_children();
+      removed( replaced );
+      orphan( replaced );
+      switch( type_of( *child ) ){
+      case S_IFDIR:
+        file_factory().destroy( name );
+        symlink_factory().destroy( name );
+        directory_factory().attach( name, child );
+        break;
+      case S_IFLNK:
+        directory_factory().destroy( name );
+        file_factory().destroy( name );
+        symlink_factory().attach( name, child );
+        break;
+      default:
+        directory_factory().destroy( name );
+        symlink_factory().destroy( name );
+        file_factory().attach( name, child );
+        break;
+      }
+      adopt( child );
+      update_change_and_modification_time();
+      return 0;
+    }
+
+    entry* detach( const char* name ){
+      if( frozen() ){
+        return 0;
+      }
+      preserve_children();
+      entry* e = directory_factory().detach( name );
+      if( !e ){
+        e = file_factory().detach( name );
+      }
+      if( !e ){
+        e = symlink_factory().detach( name );
+      }
+      if( e ){
+        orphan( e );
         update_change_and_modification_time();
       }
+      return e;
+    }
+
+    /// adds name as a further link to target. both names refer to the
+    /// same entry afterwards, which is deleted with its last link.
+    int link( const char* name, entry& target ){
+      if( frozen() ){
+        return -EROFS;
+      }
+      if( find( name ) ){
+        return -EEXIST;
+      }
+      int err = target.hold();
+      if( err ){
+        return err;
+      }
+      err = attach( name, &target );
+      if( err ){
+        target.drop();
+      }
+      else{
+        change_log::instance().record( change_link, name );
+      }
       return err;
     }
 
+    /// directories cannot be hard linked.
+    int hold(){
+      return -EPERM;
+    }
+
+    int drop(){
+      return 0;
+    }
+
+    /// rebuilds the index of the children into a perfect_hash_index,
+    /// which turns a lookup into a single probe.
+    ///
+    /// afterwards the directory rejects the creation and removal of
+    /// children with EROFS. the application may still add children
+    /// (add_directory, add_file, add_symlink), which rebuilds the index
+    /// and retires the previous one (see reclaim). a child it replaces
+    /// is deleted at once, so it must not be looked up meanwhile.
+    /// if recursive is true, the child directories are frozen as well.
+    /// a directory has to be frozen before it is looked up concurrently.
+    int freeze( bool recursive ){
+      if( recursive ){
+        freeze_children children;
+        directory_factory().visit( children );
+        if( children.err ){
+          return children.err;
+        }
+      }
+      if( !frozen() ){
+        _frozen.store( index_children(), std::memory_order_release );
+      }
+      return 0;
+    }
+
+    bool frozen() const {
+      return _frozen.load( std::memory_order_acquire ) != 0;
+    }
+
+    int scan( const std::string& prefix, child_visitor& visitor ){
+      file_factory().visit_prefix( prefix, visitor );
+      symlink_factory().visit_prefix( prefix, visitor );
+      directory_factory().visit_prefix( prefix, visitor );
+      return 0;
+    }
+
+    /// the totals of all entries below the directory, maintained
+    /// incrementally (see subtree_node).
+    subtree_size subtree(){
+      return _subtree.size() - subtree_size( 1 );
+    }
+
+    subtree_size adopted( entry* parent ){
+      return _subtree.adopt( parent );
+    }
+
+    subtree_size orphaned( entry* parent ){
+      return _subtree.orphan( parent );
+    }
+
+    void add_subtree( const subtree_size& delta ){
+      _subtree.change( delta );
+    }
+
+    unsigned long generation(){
+      return _generation.load( std::memory_order_acquire );
+    }
+
+    template< class Child >
+    Child& add_directory( const char* name, Child* child ) {
+      entry* replaced = directory_factory().find( name );
+      if( replaced != child ){
+        preserve_children();
+        removed( replaced );
+        orphan( replaced );
+      }
+      Child& added = directory_factory().add_directory( name, child );
+      if( replaced != child ){
+        created( child );
+        children_changed();
+        refreeze();
+      }
+      return added;
+    }
+
+    template< class Child >
+    Child& add_file( const char* name, Child* child ) {
+      entry* replaced = file_factory().find( name );
+      if( replaced != child ){
+        preserve_children();
+        removed( replaced );
+        orphan( replaced );
+      }
+      Child& added = file_factory().add_file( name, child );
+      if( replaced != child ){
+        created( child );
+        children_changed();
+        refreeze();
+      }
+      return added;
+    }
+
+    template< class Child >
+    Child& add_symlink( const char* name, Child* child ) {
+      entry* replaced = symlink_factory().find( name );
+      if( replaced != child ){
+        preserve_children();
+        removed( replaced );
+        orphan( replaced );
+      }
+      Child& added = symlink_factory().add_symlink( name, child );
+      if( replaced != child ){
+        created( child );
+        children_changed();
+        refreeze();
+      }
+      return added;
+    }
+
   private:
+    /// a perfect_hash_index of the current children.
+    perfect_hash_index* index_children(){
+      children_t children;
+      collect_children collector( children );
+      directory_factory().visit( collector );
+      file_factory().visit( collector );
+      symlink_factory().visit( collector );
+      return new perfect_hash_index( children );
+    }
+
+    /// replaces the index of a frozen directory whose children changed.
+    void refreeze(){
+      perfect_hash_index* previous = _frozen.load( std::memory_order_acquire );
+      if( previous ){
+        _frozen.store( index_children(), std::memory_order_release );
+        reclaim::retire( previous );
+      }
+    }
+
+    struct freeze_children {
+      freeze_children()
+        : err( 0 ){
+      }
+      void operator()( const std::string&, entry* e ){
+        if( !err ){
+          err = e->freeze( true );
+        }
+      }
+      int err;
+    };
+
+    struct orphan_children {
+      explicit orphan_children( entry* p )
+        : parent( p ){
+      }
+      void operator()( const std::string&, entry* e ){
+        e->orphaned( parent );
+      }
+      entry* parent;
+    };
+
+    entry* self(){
+      return &static_cast< Derived& >(*this);
+    }
+
+    /// keeps the children in the snapshots of the tree before they
+    /// change (see snapshot_set).
+    void preserve_children(){
+      snapshot_set::instance().preserve( *self() );
+    }
+
+    /// adds a child created after the snapshots were taken.
+    void created( entry* child ){
+      if( child ){
+        snapshot_set::instance().created( *child );
+        adopt( child );
+      }
+    }
+
+    /// keeps a child which is about to be removed in the snapshots.
+    void removed( entry* child ){
+      if( child ){
+        snapshot_set::instance().removed( *child );
+      }
+    }
+
+    /// adds the subtree of a new child.
+    void adopt( entry* child ){
+      if( child ){
+        add_subtree( child->adopted( self() ) );
+      }
+    }
+
+    /// subtracts the subtree of a child which is removed.
+    void orphan( entry* child ){
+      if( child ){
+        add_subtree( subtree_size() - child->orphaned( self() ) );
+      }
+    }
+
+    static mode_t type_of( entry& e ){
+      struct stat st;
+      ::memset( &st, 0, sizeof(st) );
+      e.stat( st );
+      return st.st_mode & S_IFMT;
+    }
+
+    /// checks whether source may replace target.
+    static int replaceable( entry& source, entry& target ){
+      struct stat st;
+      ::memset( &st, 0, sizeof(st) );
+      target.stat( st );
+      const bool source_is_dir = type_of( source ) == S_IFDIR;
+      if( ( st.st_mode & S_IFMT ) == S_IFDIR ){
+        if( !source_is_dir ){
+          return -EISDIR;
+        }
+        if( st.st_nlink > 2 ){
+          return -ENOTEMPTY;
+        }
+      }
+      else if( source_is_dir ){
+        return -ENOTDIR;
+      }
+      return 0;
+    }
+
+    int move( const char* name, entry& newparent, const char* newname, unsigned int flags ){
+      if( flags & ~( RENAME_NOREPLACE | RENAME_EXCHANGE ) ||
+          ( flags & RENAME_NOREPLACE && flags & RENAME_EXCHANGE ) ){
+        return -EINVAL;
+      }
+      if( frozen() ){
+        return -EROFS;
+      }
+      entry* source = find( name );
+      if( !source ){
+        return -ENOENT;
+      }
+      entry* target = newparent.child( newname );
+      if( target == source ){
+        return 0;
+      }
+      if( flags & RENAME_NOREPLACE && target ){
+        return -EEXIST;
+      }
+      if( flags & RENAME_EXCHANGE ){
+        if( !target ){
+          return -ENOENT;
+        }
+        return exchange( name, source, newparent, newname, target );
+      }
+      if( target ){
+        const int err = replaceable( *source, *target );
+        if( err ){
+          return err;
+        }
+      }
+      const int err = newparent.attach( newname, source );
+      if( err ){
+        return err;
+      }
+      detach( name );
+      return 0;
+    }
+
+    int exchange( const char* name, entry* source, entry& newparent, const char* newname, entry* target ){
+      entry* detached = newparent.detach( newname );
+      if( detached != target ){
+        if( detached ){
+          newparent.attach( newname, detached );
+        }
+        return -EROFS;
+      }
+      detach( name );
+      const int err = newparent.attach( newname, source );
+      if( err ){
+        newparent.attach( newname, target );
+        attach( name, source );
+        return err;
+      }
+      attach( name, target );
+      return 0;
+    }
+
+    directory_node( const directory_node& );
+    directory_node& operator=( const directory_node& );
+
     inline
     DirectoryFactory& directory_factory() {
       return static_cast< DirectoryFactory& >(*this);
@@ -122,6 +568,14 @@ namespace fusekit{
     inline
     void update_change_and_modification_time(){
       static_cast< Derived& >(*this).update( fusekit::modification_time | fusekit::change_time );
+      children_changed();
+    }
+
+    /// called after the children have changed, so a lookup cached
+    /// before carries an older generation.
+    inline
+    void children_changed(){
+      _generation.fetch_add( 1, std::memory_order_release );
     }
 
     inline
@@ -133,6 +587,10 @@ namespace fusekit{
     SymlinkFactory& symlink_factory() {
       return static_cast< SymlinkFactory& >(*this);
     }
+
+    std::atomic< perfect_hash_index* > _frozen;
+    std::atomic< unsigned long > _generation;
+    subtree_node _subtree;
   };
 
 }
@@ -4,10 +4,13 @@
 
 #include <errno.h>
 #include <string>
-#include <fuse/fuse.h>
+#include <fusekit/fuse.h>
+#include <fusekit/subtree_size.h>
 
 namespace fusekit{
 
+  struct child_visitor;
+
   /// interface base class for all entries/elements of a file hierarchy
   /// 
   /// all file operations will be forwarded by the daemon to an implementation
@@ -24,7 +27,7 @@ namespace fusekit{
     virtual int read( char*, size_t, off_t, fuse_file_info& ) = 0;
     virtual int write( const char*, size_t, off_t, fuse_file_info& ) = 0;
     virtual int opendir( fuse_file_info& ) = 0;
-    virtual int readdir( void*, fuse_fill_dir_t, off_t, fuse_file_info& ) = 0;
+    virtual int readdir( void*, fill_dir_t, off_t, fuse_file_info& ) = 0;
     virtual int releasedir( fuse_file_info& ) = 0;
     virtual int mknod( const char*, mode_t, dev_t ) = 0;
     virtual int unlink( const char* ) = 0;
@@ -39,6 +42,52 @@ namespace fusekit{
     virtual int getxattr( const char*, char*, size_t ) = 0;
     virtual int listxattr( char*, size_t ) = 0;
     virtual int removexattr( const char* ) = 0;
+    /// makes the children of a directory immutable (see directory_node::freeze).
+    virtual int freeze( bool recursive ) = 0;
+    /// moves the child name to newname of the directory newparent.
+    virtual int rename( const char* name, entry& newparent, const char* newname, unsigned int flags ) = 0;
+    /// adds an existing entry as child, replacing a child of the same name.
+    virtual int attach( const char* name, entry* child ) = 0;
+    /// removes a child without deleting it.
+    virtual entry* detach( const char* name ) = 0;
+    /// creates the hard link name to target.
+    virtual int link( const char* name, entry& target ) = 0;
+    /// adds a reference (a directory link) to the entry.
+    virtual int hold() = 0;
+    /// removes a reference and returns the number of remaining references.
+    virtual int drop() = 0;
+    /// calls visitor( name, entry ) for the children of a directory whose
+    /// names start with prefix, using the ordering of the index if it has one.
+    virtual int scan( const std::string& prefix, child_visitor& visitor ) = 0;
+    /// the totals of the entries below a directory (see subtree_node).
+    virtual subtree_size subtree() = 0;
+    /// registers parent as a parent of the entry and returns the size the
+    /// parent has to add: the entry itself and everything below it.
+    virtual subtree_size adopted( entry* parent ) = 0;
+    /// unregisters parent and returns the size it has to subtract.
+    virtual subtree_size orphaned( entry* parent ) = 0;
+    /// adds the change of the size of a child's subtree.
+    virtual void add_subtree( const subtree_size& delta ) = 0;
+    /// a number which changes whenever a child of a directory is added,
+    /// removed or replaced, so lookups can be cached. 0 if the directory
+    /// cannot tell (or the entry is no directory): nothing may be cached.
+    virtual unsigned long generation() = 0;
+    /// finds data or holes of a file (SEEK_DATA, SEEK_HOLE), see lseek(2).
+    virtual off_t lseek( off_t offset, int whence, fuse_file_info& fi ) = 0;
+    /// preallocates or deallocates the storage of a range of a file, see fallocate(2).
+    virtual int fallocate( int mode, off_t offset, off_t length, fuse_file_info& fi ) = 0;
+    /// copies len bytes to the file out without passing them through the daemon.
+    virtual ssize_t copy_file_range( fuse_file_info& fi_in, off_t off_in, entry& out, fuse_file_info& fi_out, off_t off_out, size_t len, int flags ) = 0;
+    /// stat of an open file, fstat(2) (fgetattr, getattr with a file info in fuse 3).
+    virtual int fstat( struct stat&, fuse_file_info& fi ) = 0;
+    /// truncates an open file, ftruncate(2).
+    virtual int ftruncate( off_t, fuse_file_info& fi ) = 0;
+    /// changes the mode of an open file, fchmod(2) (fuse 3 only).
+    virtual int fchmod( mode_t, fuse_file_info& fi ) = 0;
+    /// a restricted ioctl(2) of an open file or directory: data holds the
+    /// _IOC_SIZE( cmd ) bytes of the argument, and the result for an
+    /// _IOR command. -ENOTTY for unknown commands.
+    virtual int ioctl( unsigned int cmd, void* data, fuse_file_info& fi ) = 0;
   };
 }
 
@@ -3,9 +3,12 @@
 #define __FUSEKIT__FILE_FACTORY_H
 
 #include <string>
-#include <tr1/unordered_map>
 #include <fusekit/no_lock.h>
 #include <fusekit/entry.h>
+#include <fusekit/usage.h>
+#include <fusekit/change_log.h>
+#include <fusekit/child_index.h>
+#include <fusekit/hashed_index.h>
 #include <fusekit/file_node.h>
 #include <fusekit/no_creator.h>
 
@@ -14,111 +17,141 @@ namespace fusekit{
   struct no_file_creator : public no_creator{
   };
 
-  template< class Creator = no_file_creator, class LockingPolicy = no_lock >
+  template< class Creator = no_file_creator, class LockingPolicy = no_lock, class Index = hashed_index >
   struct file_factory : public LockingPolicy{
-    typedef std::tr1::unordered_map< std::string, entry* > map_t;
-    typedef typename file_factory< Creator, LockingPolicy >::lock lock;
+    typedef Index map_t;
+    typedef typename file_factory< Creator, LockingPolicy, Index >::lock lock;
+    typedef typename map_t::template read_lock< lock >::type read_lock;
 
     ~file_factory() {
       lock guard(*this);
-      map_t::const_iterator e = _added_files.begin();
-      while( e != _added_files.end() ){
-	delete e->second;
-	++e;
-      }
-      e = _created_files.begin();
-      while( e != _created_files.end() ){
-	delete e->second;
-	++e;
-      }
+      delete_entries deleter;
+      _added_files.visit( deleter );
+      _created_files.visit( deleter );
     }
 
     entry* find( const char* name ) {
-      lock guard(*this);
-      map_t::const_iterator e = _added_files.find( name );
-      if( e != _added_files.end() ) {
-  	return e->second;
-      }
-      e = _created_files.find( name );
-      if( e != _created_files.end() ) {
-  	return e->second;
-      }
-      return 0;
+      read_lock guard(*this);
+      return find_locked( name );
     }
 
     template< class Child >
     Child& add_file( const char* name, Child* child ) {
       lock guard(*this);
-      const map_t::key_type key( name );
-      map_t::iterator e = _added_files.find( name );
-      if( e != _added_files.end() ) {
-    	delete e->second;
+      entry* replaced = _added_files.insert( name, child );
+      if( replaced ) {
+	map_t::retire( replaced );
       }
-      _added_files[ name ] = child;
+      change_log::instance().record( change_add, name );
       return *child;
     }
     
     int size() {
-      lock guard(*this);
+      read_lock guard(*this);
       return _added_files.size() + _created_files.size();
     }
 
     name_container_t names() {
-      lock guard(*this);
+      read_lock guard(*this);
       name_container_t names;
-      map_t::const_iterator i = _added_files.begin();
-      while( i != _added_files.end() ) {
-	names.insert( i->first.c_str() );
-	++i;
-      }
-      i = _created_files.begin();
-      while( i != _created_files.end() ) {
-	names.insert( i->first.c_str() );
-	++i;
-      }
+      collect_names collector( names );
+      _added_files.visit( collector );
+      _created_files.visit( collector );
       return names;
     }
 
+    /// calls visitor( name, entry ) for all children.
+    template< class Visitor >
+    void visit( Visitor& visitor ) {
+      read_lock guard(*this);
+      _added_files.visit( visitor );
+      _created_files.visit( visitor );
+    }
+
+    /// calls visitor( name, entry ) for the children whose names start with prefix.
+    template< class Visitor >
+    void visit_prefix( const std::string& prefix, Visitor& visitor ) {
+      read_lock guard(*this);
+      fusekit::visit_prefix( _added_files, prefix, visitor );
+      fusekit::visit_prefix( _created_files, prefix, visitor );
+    }
+
     int create( const char* name, mode_t mode, dev_t type ){
       lock guard(*this);
-      if( find( name ) ){
+      if( find_locked( name ) ){
 	return -EEXIST;
       }
+      const int err = usage::instance().check_inode();
+      if( err ){
+	return err;
+      }
       entry* d = _creator();
       if( !d ){
 	return -EROFS;
       }
-      int chmod_err = d->chmod( mode );
+      int chmod_err;
+      {
+	// the mode is part of the create
+	change_log::quiet creating;
+	chmod_err = d->chmod( mode );
+      }
       if( chmod_err ){
 	delete d;
 	return chmod_err;
       }
-      _created_files[name] = d;
+      _created_files.insert( name, d );
+      change_log::instance().record( change_create, name );
       return 0;
     }
 
     int destroy( const char* name ){
       lock guard(*this);
-      entry* ep = 0;
-      map_t::const_iterator e = _added_files.find( name );
-      if( e != _added_files.end() ) {
-  	ep = e->second;
-	_added_files.erase(e);
-      }
-      else if( (e = _created_files.find( name )) != _created_files.end() ){
-	ep = e->second;
-	_created_files.erase(e);
-      }
-      
+      entry* ep = detach_locked( name );
       if( ep ){
-	delete ep;
+	change_log::instance().record( change_remove, name );
+	map_t::retire( ep );
 	return 0;
       }
       else{
 	return -ENOENT;
       }
     }
+
+    /// removes the child name without deleting it and returns it or 0.
+    entry* detach( const char* name ){
+      lock guard(*this);
+      return detach_locked( name );
+    }
+
+    /// adds an existing entry as child name. a child with the same name
+    /// is replaced in a single step, so the name never disappears.
+    void attach( const char* name, entry* child ){
+      lock guard(*this);
+      entry* replaced = _added_files.find( name )
+	? _added_files.insert( name, child )
+	: _created_files.insert( name, child );
+      if( replaced && replaced != child ){
+	map_t::retire( replaced );
+      }
+    }
   private:
+    /// find and detach without taking the lock, for callers holding it.
+    entry* find_locked( const char* name ) {
+      entry* e = _added_files.find( name );
+      if( e ) {
+	return e;
+      }
+      return _created_files.find( name );
+    }
+
+    entry* detach_locked( const char* name ){
+      entry* ep = _added_files.erase( name );
+      if( !ep ){
+	ep = _created_files.erase( name );
+      }
+      return ep;
+    }
+
     Creator _creator;
     map_t _added_files;
     map_t _created_files;
@@ -0,0 +1,38 @@
+
+#ifndef __FUSEKIT__FUSE_H
+#define __FUSEKIT__FUSE_H
+
+#ifndef FUSE_USE_VERSION
+#pragma message "FUSE_USE_VERSION is not defined. setting FUSE_USE_VERSION=27"
+#define FUSE_USE_VERSION 27
+#endif
+
+/// the fuse api fusekit is built against, selected by FUSE_USE_VERSION:
+/// 30 to 35 use libfuse3, older versions libfuse2 (see configure
+/// --with-fuse).
+#if FUSE_USE_VERSION >= 30
+#include <fuse3/fuse.h>
+#include <fuse3/fuse_lowlevel.h>
+#else
+#include <fuse/fuse.h>
+#include <fuse/fuse_lowlevel.h>
+#endif
+
+namespace fusekit{
+
+  /// the filler of entry::readdir, the fuse 2 signature. with fuse 3 the
+  /// daemon passes an adapter to the filler of fuse.
+  typedef int (*fill_dir_t)( void* buf, const char* name, const struct stat* stbuf, off_t offset );
+
+  /// the command of the ioctl handler, unsigned since fuse 3.5.
+#if FUSE_USE_VERSION >= 35
+  typedef unsigned int ioctl_cmd_t;
+#else
+  typedef int ioctl_cmd_t;
+#endif
+
+}
+
+#endif
+
+
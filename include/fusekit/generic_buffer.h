@@ -4,9 +4,11 @@
 
 #include <error.h>
 #include <fcntl.h>
+#include <unistd.h>
 #include <fusekit/entry.h>
 #include <fusekit/file_handle.h>
 #include <fusekit/time_fields.h>
+#include <fusekit/change_log.h>
 
 namespace fusekit{
   template< 
@@ -96,6 +98,9 @@ namespace fusekit{
       }
       file_handle* fh = reinterpret_cast< file_handle* >(fi.fh);
       fh->last_write_err = fh->writer(buf,size,offset);
+      if( fh->last_write_err > 0 ){
+	change_log::instance().record( change_write );
+      }
       return fh->last_write_err;
     }
 
@@ -118,6 +123,28 @@ namespace fusekit{
       return -EINVAL;
     }
 
+    blkcnt_t blocks(){
+      return ( MaxSize + 511 ) / 512;
+    }
+
+    /// the content has no holes.
+    off_t lseek( off_t offset, int whence, fuse_file_info& ){
+      if( offset < 0 || offset >= MaxSize ){
+        return -ENXIO;
+      }
+      return whence == SEEK_DATA ? offset : MaxSize;
+    }
+
+    int fallocate( int, off_t, off_t, fuse_file_info& ){
+      return -EOPNOTSUPP;
+    }
+
+    /// the content is produced by the reader, so it cannot be copied
+    /// without reading it: the kernel falls back to read and write.
+    ssize_t copy_file_range( fuse_file_info&, off_t, entry&, fuse_file_info&, off_t, size_t, int ){
+      return -EOPNOTSUPP;
+    }
+
   private:
     Reader _reader;
     Writer _writer;
@@ -0,0 +1,86 @@
+
+#ifndef __FUSEKIT__HASHED_INDEX_H
+#define __FUSEKIT__HASHED_INDEX_H
+
+#include <string>
+#include <tr1/unordered_map>
+#include <fusekit/entry.h>
+
+namespace fusekit{
+
+  /// the default child index of the factories: a hash map from
+  /// the name of a child to its entry.
+  ///
+  /// an index only maps names to entries, it never deletes them.
+  /// the factories hold a reference to each child and hand it back to
+  /// the index by calling retire. the entry is deleted with its last
+  /// reference, an index may delay the deletion (see rcu_index).
+  struct hashed_index {
+    typedef std::tr1::unordered_map< std::string, entry* > map_t;
+
+    /// type of the guard a factory holds while reading from the index.
+    /// reads of a hashed_index have to be serialized with the writers,
+    /// so the factory lock is used.
+    template< class Lock >
+    struct read_lock {
+      typedef Lock type;
+    };
+
+    entry* find( const char* name ) const {
+      map_t::const_iterator e = _map.find( name );
+      if( e != _map.end() ){
+        return e->second;
+      }
+      return 0;
+    }
+
+    /// adds (or replaces) the child name and returns the replaced
+    /// entry or 0.
+    entry* insert( const char* name, entry* child ){
+      entry*& e = _map[ name ];
+      entry* replaced = e;
+      e = child;
+      return replaced;
+    }
+
+    /// removes the child name and returns its entry or 0.
+    entry* erase( const char* name ){
+      map_t::iterator e = _map.find( name );
+      if( e == _map.end() ){
+        return 0;
+      }
+      entry* erased = e->second;
+      _map.erase( e );
+      return erased;
+    }
+
+    size_t size() const {
+      return _map.size();
+    }
+
+    /// calls visitor( name, entry ) for all children.
+    template< class Visitor >
+    void visit( Visitor& visitor ) const {
+      map_t::const_iterator i = _map.begin();
+      while( i != _map.end() ){
+        visitor( i->first, i->second );
+        ++i;
+      }
+    }
+
+    static void retire( entry* e ){
+      if( e->drop() == 0 ){
+        delete e;
+      }
+    }
+
+  private:
+    map_t _map;
+  };
+
+}
+
+#endif
+
+
+
@@ -0,0 +1,227 @@
+
+#ifndef __FUSEKIT__HOST_BUFFER_H
+#define __FUSEKIT__HOST_BUFFER_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <mutex>
+#include <fusekit/entry.h>
+#include <fusekit/io_engine.h>
+#include <fusekit/time_fields.h>
+#include <fusekit/change_log.h>
+
+#ifndef SEEK_DATA
+#define SEEK_DATA 3
+#endif
+#ifndef SEEK_HOLE
+#define SEEK_HOLE 4
+#endif
+
+namespace fusekit{
+
+  /// the descriptor of a host file behind a host_buffer.
+  ///
+  /// reads and writes give their offsets (pread, pwrite), lseek uses a
+  /// second descriptor of the file, so the offset of the first one is
+  /// never moved.
+  struct host_descriptor {
+    host_descriptor()
+      : _fd( -1 )
+      , _seek_fd( -1 )
+      , _reported_size( 0 )
+      , _reported_blocks( 0 ){
+    }
+
+    virtual ~host_descriptor(){
+      release();
+    }
+
+    /// opens path with flags (see open(2)) as content of the file.
+    /// -errno on failure.
+    int bind( const char* path, int flags = O_RDWR ){
+      const int fd = ::open( path, flags | O_CLOEXEC );
+      if( fd < 0 ){
+        return -errno;
+      }
+      release();
+      _fd = fd;
+      _seek_fd = ::open( path, O_RDONLY | O_CLOEXEC );
+      struct stat st;
+      if( ::fstat( _fd, &st ) == 0 ){
+        _reported_size = st.st_size;
+        _reported_blocks = st.st_blocks;
+      }
+      io_engine::instance().register_file( _fd );
+      return 0;
+    }
+
+    int descriptor() const {
+      return _fd;
+    }
+
+    /// the descriptor lseek moves, -1 if the file cannot be opened for
+    /// reading.
+    int seek_descriptor() const {
+      return _seek_fd;
+    }
+
+  private:
+    host_descriptor( const host_descriptor& );
+    host_descriptor& operator=( const host_descriptor& );
+
+    void release(){
+      if( _fd >= 0 ){
+        io_engine::instance().unregister_file( _fd );
+        ::close( _fd );
+        _fd = -1;
+      }
+      if( _seek_fd >= 0 ){
+        ::close( _seek_fd );
+        _seek_fd = -1;
+      }
+    }
+
+    int _fd;
+    int _seek_fd;
+
+  protected:
+    /// the size and the blocks of the file when it last changed.
+    off_t _reported_size;
+    blkcnt_t _reported_blocks;
+  };
+
+  /// buffer policy keeping the content of a file in a host file, e.g. a
+  /// passthrough of a directory of the host. reads and writes go through
+  /// the io_engine, which splits large ones into chunks submitted
+  /// together.
+  template<
+    class Derived
+    >
+  struct host_buffer
+    : public host_descriptor {
+
+    int open( fuse_file_info& ){
+      return descriptor() < 0 ? -EBADF : 0;
+    }
+
+    int close( fuse_file_info& ){
+      return 0;
+    }
+
+    off_t size(){
+      struct stat st;
+      return ::fstat( descriptor(), &st ) == 0 ? st.st_size : 0;
+    }
+
+    blkcnt_t blocks(){
+      struct stat st;
+      return ::fstat( descriptor(), &st ) == 0 ? st.st_blocks : 0;
+    }
+
+    int read( char* buf, size_t size, off_t offset, fuse_file_info& ){
+      return io_engine::instance().read( descriptor(), buf, size, offset );
+    }
+
+    int write( const char* buf, size_t size, off_t offset, fuse_file_info& ){
+      const int written = io_engine::instance().write( descriptor(), buf, size, offset );
+      if( written > 0 ){
+        change_log::instance().record( change_write );
+        changed();
+      }
+      return written;
+    }
+
+    int truncate( off_t size ){
+      if( ::ftruncate( descriptor(), size ) != 0 ){
+        return -errno;
+      }
+      change_log::instance().record( change_truncate );
+      changed();
+      return 0;
+    }
+
+    int flush( fuse_file_info& ){
+      return 0;
+    }
+
+    int fallocate( int mode, off_t offset, off_t length, fuse_file_info& ){
+      if( ::fallocate( descriptor(), mode, offset, length ) != 0 ){
+        return -errno;
+      }
+      change_log::instance().record( change_write );
+      changed();
+      return 0;
+    }
+
+    /// SEEK_DATA or SEEK_HOLE. without a seek_descriptor the file is
+    /// taken as data up to its end.
+    off_t lseek( off_t offset, int whence, fuse_file_info& ){
+      if( whence != SEEK_DATA && whence != SEEK_HOLE ){
+        return -EINVAL;
+      }
+      if( seek_descriptor() < 0 ){
+        const off_t end = size();
+        if( offset < 0 || offset >= end ){
+          return -ENXIO;
+        }
+        return whence == SEEK_DATA ? offset : end;
+      }
+      const off_t res = ::lseek( seek_descriptor(), offset, whence );
+      return res < 0 ? -errno : res;
+    }
+
+    int readlink( char*, size_t ){
+      return -EINVAL;
+    }
+
+    /// server side copy into another host backed file, by the host file
+    /// system (reflinks where it supports them).
+    ssize_t copy_file_range( fuse_file_info&, off_t off_in, entry& out, fuse_file_info&, off_t off_out, size_t len, int flags ){
+      host_descriptor* target = dynamic_cast< host_descriptor* >( &out );
+      if( !target ){
+        return -EOPNOTSUPP;
+      }
+      loff_t in = off_in;
+      loff_t to = off_out;
+      const ssize_t copied = ::copy_file_range( descriptor(), &in, target->descriptor(), &to, len, flags );
+      if( copied < 0 ){
+        return -errno;
+      }
+      if( copied > 0 ){
+        change_log::instance().record( change_write );
+      }
+      return copied;
+    }
+
+  private:
+    /// passes the change of the size and the blocks since the last
+    /// change on to the entry.
+    void changed(){
+      static_cast< Derived* >(this)->update( fusekit::modification_time | fusekit::change_time );
+      struct stat st;
+      if( ::fstat( descriptor(), &st ) != 0 ){
+        return;
+      }
+      off_t bytes;
+      blkcnt_t blocks;
+      {
+        std::lock_guard< std::mutex > guard( _mutex );
+        bytes = st.st_size - _reported_size;
+        blocks = st.st_blocks - _reported_blocks;
+        _reported_size = st.st_size;
+        _reported_blocks = st.st_blocks;
+      }
+      static_cast< Derived* >(this)->resized( bytes, blocks );
+    }
+
+    std::mutex _mutex;
+  };
+
+}
+
+#endif
+
+
+
@@ -0,0 +1,37 @@
+
+#ifndef __FUSEKIT__HOST_FILE_H
+#define __FUSEKIT__HOST_FILE_H
+
+#include <fcntl.h>
+#include <fusekit/basic_file.h>
+#include <fusekit/host_buffer.h>
+
+namespace fusekit {
+
+  /// a regular file with its content in a file of the host.
+  template<
+    template <class> class TimePolicy = default_time,
+    template <class> class PermissionPolicy = default_file_permissions
+    >
+  struct host_file{
+    typedef basic_file< host_buffer, TimePolicy, PermissionPolicy > type;
+  };
+
+  /// the host file path, opened with flags, 0 if it cannot be opened:
+  /// root.add_file( "data", make_host_file( "/srv/data" ) );
+  inline
+  host_file<>::type* make_host_file( const char* path, int flags = O_RDWR ){
+    host_file<>::type* f = new host_file<>::type;
+    if( f->bind( path, flags ) != 0 ){
+      delete f;
+      return 0;
+    }
+    return f;
+  }
+
+}
+
+#endif
+
+
+
@@ -0,0 +1,148 @@
+
+#ifndef __FUSEKIT__INDEXED_XATTR_H
+#define __FUSEKIT__INDEXED_XATTR_H
+
+#include <string.h>
+#include <string>
+#include <vector>
+#include <fusekit/entry.h>
+#include <fusekit/default_xattr.h>
+#include <fusekit/xattr_index.h>
+
+namespace fusekit{
+
+  /// default_xattr which keeps the xattr_index up to date, so the
+  /// entry can be found by its attribute values (see xattr_directory).
+  /// the entry is indexed in the index current at its first setxattr,
+  /// and leaves that index when it is destroyed. an entry indexed in the
+  /// process wide index moves to the current index of the first scope
+  /// which reads or changes its attributes.
+  template<
+    class Derived
+    >
+  struct indexed_xattr
+    : public default_xattr< Derived > {
+
+    indexed_xattr()
+      : _indexed( 0 )
+      , _index( 0 ){
+    }
+
+    ~indexed_xattr(){
+      if( !_indexed ){
+        return;
+      }
+      std::vector< char > names;
+      std::string value;
+      for( size_t i = 0; i < attribute_names( names ); i += ::strlen( &names[i] ) + 1 ){
+        if( current( &names[i], value ) ){
+          _index->remove( &names[i], value, _indexed );
+        }
+      }
+    }
+
+    int setxattr( const char *name, const char *value, size_t size, int flags ){
+      std::string old;
+      const bool existed = current( name, old );
+      const int err = default_xattr< Derived >::setxattr( name, value, size, flags );
+      if( err == 0 ){
+        if( existed ){
+          index().remove( name, old, self() );
+        }
+        index().add( name, std::string( value, size ), self() );
+      }
+      return err;
+    }
+
+    int getxattr( const char *name, char *value, size_t size ){
+      if( _index ){
+        index();
+      }
+      return default_xattr< Derived >::getxattr( name, value, size );
+    }
+
+    int listxattr( char *list, size_t size ){
+      if( _index ){
+        index();
+      }
+      return default_xattr< Derived >::listxattr( list, size );
+    }
+
+    int removexattr( const char *name ){
+      std::string old;
+      const bool existed = current( name, old );
+      const int err = default_xattr< Derived >::removexattr( name );
+      if( err == 0 && existed ){
+        index().remove( name, old, self() );
+      }
+      return err;
+    }
+
+  private:
+    /// the entry, remembered for the destructor, where the derived
+    /// part is gone already.
+    entry* self(){
+      if( !_indexed ){
+        _indexed = static_cast< Derived* >( this );
+      }
+      return _indexed;
+    }
+
+    /// the index of the entry, moved from the process wide index to the
+    /// current one inside of a scope.
+    xattr_index& index(){
+      xattr_index& now = xattr_index::instance();
+      if( !_index ){
+        _index = &now;
+      }
+      else if( _index != &now && _index == &xattr_index::process() ){
+        std::vector< char > names;
+        std::string value;
+        for( size_t i = 0; i < attribute_names( names ); i += ::strlen( &names[i] ) + 1 ){
+          if( current( &names[i], value ) ){
+            _index->remove( &names[i], value, self() );
+            now.add( &names[i], value, self() );
+          }
+        }
+        _index = &now;
+      }
+      return *_index;
+    }
+
+    /// fills names with the attribute names, returns their size.
+    size_t attribute_names( std::vector< char >& names ){
+      const int size = default_xattr< Derived >::listxattr( 0, 0 );
+      if( size <= 0 ){
+        return 0;
+      }
+      names.resize( size );
+      if( default_xattr< Derived >::listxattr( &names[0], names.size() ) != size ){
+        return 0;
+      }
+      return size;
+    }
+
+    /// the current value of name, false if it is not set.
+    bool current( const char* name, std::string& value ){
+      const int size = default_xattr< Derived >::getxattr( name, 0, 0 );
+      if( size < 0 ){
+        return false;
+      }
+      std::vector< char > buffer( size + 1 );
+      if( default_xattr< Derived >::getxattr( name, &buffer[0], size ) != size ){
+        return false;
+      }
+      value.assign( buffer.begin(), buffer.begin() + size );
+      return true;
+    }
+
+    entry* _indexed;
+    xattr_index* _index;
+  };
+
+}
+
+#endif
+
+
+
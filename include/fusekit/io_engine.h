@@ -0,0 +1,391 @@
+
+#ifndef __FUSEKIT__IO_ENGINE_H
+#define __FUSEKIT__IO_ENGINE_H
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+#ifdef __linux__
+#include <sys/mman.h>
+#include <linux/io_uring.h>
+#endif
+
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+#define FUSEKIT_IO_URING 1
+#endif
+
+namespace fusekit{
+
+  /// reads and writes of host files for the buffer policies (see
+  /// host_buffer), through io_uring where the kernel offers it.
+  ///
+  /// the operations of all threads share one ring. a thread queues its
+  /// operations, submits them and waits for their completions, the other
+  /// threads meanwhile queue and submit theirs, and the waiting threads
+  /// take turns in collecting the completions of all of them. the
+  /// daemon runs one operation at a time (see daemon::lock), so its
+  /// requests do not overlap on the ring: the depth comes from a large
+  /// read or write, which is split into chunks submitted as one batch,
+  /// and from application threads using the engine outside the daemon.
+  ///
+  /// no more operations are in flight than the completion queue holds,
+  /// since kernels without IORING_FEAT_NODROP drop the completions which
+  /// do not fit.
+  ///
+  /// files are registered with the ring (register_file), which saves
+  /// the lookup of the file for every operation. without io_uring or
+  /// its read and write operations (kernels before 5.6, seccomp filters)
+  /// the engine falls back to pread and pwrite.
+  struct io_engine {
+    static io_engine& instance(){
+      static io_engine e;
+      return e;
+    }
+
+    /// chunks larger reads and writes are split into.
+    enum { chunk_size = 128 * 1024 };
+
+    explicit io_engine( unsigned entries = 256 )
+      : _ring( -1 )
+      , _entries( 0 )
+      , _completions( 0 )
+      , _in_flight( 0 )
+      , _reaping( false ){
+#ifdef FUSEKIT_IO_URING
+      setup( entries );
+#endif
+    }
+
+    ~io_engine(){
+#ifdef FUSEKIT_IO_URING
+      if( _ring >= 0 ){
+        teardown();
+      }
+#endif
+    }
+
+    /// true if the operations go through io_uring.
+    bool uring() const {
+      return _ring >= 0;
+    }
+
+    /// registers fd with the ring. unregister_file before closing it.
+    void register_file( int fd ){
+#ifdef FUSEKIT_IO_URING
+      std::lock_guard< std::mutex > guard( _mutex );
+      if( _ring < 0 || _slots.empty() || fd < 0 ){
+        return;
+      }
+      std::vector< int >::iterator free = std::find( _slots.begin(), _slots.end(), -1 );
+      if( free == _slots.end() ){
+        return;
+      }
+      const int slot = free - _slots.begin();
+      if( update_file( slot, fd ) ){
+        _slots[ slot ] = fd;
+      }
+#endif
+    }
+
+    void unregister_file( int fd ){
+#ifdef FUSEKIT_IO_URING
+      std::lock_guard< std::mutex > guard( _mutex );
+      std::vector< int >::iterator i = std::find( _slots.begin(), _slots.end(), fd );
+      if( fd >= 0 && i != _slots.end() ){
+        update_file( i - _slots.begin(), -1 );
+        *i = -1;
+      }
+#endif
+    }
+
+    /// pread(2), -errno on failure.
+    ssize_t read( int fd, void* buf, size_t size, off_t offset ){
+      return transfer( fd, static_cast< char* >( buf ), size, offset, false );
+    }
+
+    /// pwrite(2), -errno on failure.
+    ssize_t write( int fd, const void* buf, size_t size, off_t offset ){
+      return transfer( fd, static_cast< char* >( const_cast< void* >( buf ) ), size, offset, true );
+    }
+
+  private:
+    io_engine( const io_engine& );
+    io_engine& operator=( const io_engine& );
+
+    struct operation {
+      operation()
+        : result( 0 )
+        , done( false ){
+      }
+      int result;
+      bool done;
+    };
+
+    ssize_t transfer( int fd, char* buf, size_t size, off_t offset, bool writing ){
+      if( _ring < 0 ){
+        const ssize_t res = writing ? ::pwrite( fd, buf, size, offset ) : ::pread( fd, buf, size, offset );
+        return res < 0 ? -errno : res;
+      }
+      const size_t count = size ? ( size + chunk_size - 1 ) / chunk_size : 1;
+      std::vector< operation > operations( count );
+      std::unique_lock< std::mutex > guard( _mutex );
+      for( size_t i = 0; i < count; ++i ){
+        const size_t length = std::min< size_t >( chunk_size, size - i * chunk_size );
+        queue( guard, fd, buf + i * chunk_size, length, offset + i * chunk_size, writing, &operations[i] );
+      }
+      const unsigned queued = pending();
+      guard.unlock();
+      enter( queued, 0 );
+      guard.lock();
+      for( size_t i = 0; i < count; ++i ){
+        wait( guard, operations[i] );
+      }
+      // the bytes up to the first short or failed chunk
+      ssize_t transferred = 0;
+      for( size_t i = 0; i < count; ++i ){
+        const int res = operations[i].result;
+        if( res < 0 ){
+          return transferred ? transferred : res;
+        }
+        transferred += res;
+        if( static_cast< size_t >( res ) < std::min< size_t >( chunk_size, size - i * chunk_size ) ){
+          break;
+        }
+      }
+      return transferred;
+    }
+
+#ifdef FUSEKIT_IO_URING
+    struct ring {
+      void* map;
+      size_t map_size;
+      unsigned* head;
+      unsigned* tail;
+      unsigned* mask;
+    };
+
+    void setup( unsigned entries ){
+      struct io_uring_params p;
+      ::memset( &p, 0, sizeof(p) );
+      const int fd = ::syscall( __NR_io_uring_setup, entries, &p );
+      if( fd < 0 ){
+        return;
+      }
+      _sq.map_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+      _cq.map_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+      if( p.features & IORING_FEAT_SINGLE_MMAP ){
+        _sq.map_size = _cq.map_size = std::max( _sq.map_size, _cq.map_size );
+      }
+      _sq.map = ::mmap( 0, _sq.map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING );
+      _cq.map = p.features & IORING_FEAT_SINGLE_MMAP ? _sq.map
+        : ::mmap( 0, _cq.map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING );
+      void* sqes = ::mmap( 0, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES );
+      if( _sq.map == MAP_FAILED || _cq.map == MAP_FAILED || sqes == MAP_FAILED ){
+        if( _sq.map != MAP_FAILED ){
+          ::munmap( _sq.map, _sq.map_size );
+        }
+        if( _cq.map != MAP_FAILED && _cq.map != _sq.map ){
+          ::munmap( _cq.map, _cq.map_size );
+        }
+        if( sqes != MAP_FAILED ){
+          ::munmap( sqes, p.sq_entries * sizeof(struct io_uring_sqe) );
+        }
+        ::close( fd );
+        return;
+      }
+      char* sq = static_cast< char* >( _sq.map );
+      _sq.head = reinterpret_cast< unsigned* >( sq + p.sq_off.head );
+      _sq.tail = reinterpret_cast< unsigned* >( sq + p.sq_off.tail );
+      _sq.mask = reinterpret_cast< unsigned* >( sq + p.sq_off.ring_mask );
+      _array = reinterpret_cast< unsigned* >( sq + p.sq_off.array );
+      char* cq = static_cast< char* >( _cq.map );
+      _cq.head = reinterpret_cast< unsigned* >( cq + p.cq_off.head );
+      _cq.tail = reinterpret_cast< unsigned* >( cq + p.cq_off.tail );
+      _cq.mask = reinterpret_cast< unsigned* >( cq + p.cq_off.ring_mask );
+      _cqes = reinterpret_cast< struct io_uring_cqe* >( cq + p.cq_off.cqes );
+      _sqes = static_cast< struct io_uring_sqe* >( sqes );
+      _entries = p.sq_entries;
+      _completions = p.cq_entries;
+      _ring = fd;
+      if( !supported() ){
+        teardown();
+        _ring = -1;
+        return;
+      }
+      // a sparse table of registered files, filled by register_file
+      std::vector< int > files( 64, -1 );
+      if( ::syscall( __NR_io_uring_register, _ring, IORING_REGISTER_FILES, &files[0], files.size() ) == 0 ){
+        _slots = files;
+      }
+    }
+
+    /// true if the kernel knows IORING_OP_READ and IORING_OP_WRITE, which
+    /// came with 5.6 like the probe itself.
+    bool supported(){
+      std::vector< char > buffer( sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op) );
+      struct io_uring_probe* probe = reinterpret_cast< struct io_uring_probe* >( &buffer[0] );
+      if( ::syscall( __NR_io_uring_register, _ring, IORING_REGISTER_PROBE, probe, 256 ) < 0 ){
+        return false;
+      }
+      return probe->last_op >= IORING_OP_READ && probe->last_op >= IORING_OP_WRITE &&
+        probe->ops[ IORING_OP_READ ].flags & IO_URING_OP_SUPPORTED &&
+        probe->ops[ IORING_OP_WRITE ].flags & IO_URING_OP_SUPPORTED;
+    }
+
+    void teardown(){
+      ::munmap( _sq.map, _sq.map_size );
+      if( _cq.map != _sq.map ){
+        ::munmap( _cq.map, _cq.map_size );
+      }
+      ::munmap( _sqes, _entries * sizeof(struct io_uring_sqe) );
+      ::close( _ring );
+    }
+
+    bool update_file( int slot, int fd ){
+      struct io_uring_files_update update;
+      ::memset( &update, 0, sizeof(update) );
+      update.offset = slot;
+      update.fds = reinterpret_cast< unsigned long >( &fd );
+      return ::syscall( __NR_io_uring_register, _ring, IORING_REGISTER_FILES_UPDATE, &update, 1 ) == 1;
+    }
+
+    /// adds an operation to the submission queue, after waiting for
+    /// completions while the submission queue is full or the completion
+    /// queue could not take one more. called with the mutex held.
+    void queue( std::unique_lock< std::mutex >& guard, int fd, char* buf, size_t size, off_t offset, bool writing, operation* o ){
+      while( pending() >= _entries || _in_flight >= _completions ){
+        collect( guard );
+      }
+      ++_in_flight;
+      const unsigned tail = *_sq.tail;
+      const unsigned index = tail & *_sq.mask;
+      struct io_uring_sqe& sqe = _sqes[ index ];
+      ::memset( &sqe, 0, sizeof(sqe) );
+      sqe.opcode = writing ? IORING_OP_WRITE : IORING_OP_READ;
+      std::vector< int >::const_iterator slot = std::find( _slots.begin(), _slots.end(), fd );
+      if( slot != _slots.end() ){
+        sqe.fd = slot - _slots.begin();
+        sqe.flags = IOSQE_FIXED_FILE;
+      }
+      else{
+        sqe.fd = fd;
+      }
+      sqe.addr = reinterpret_cast< unsigned long >( buf );
+      sqe.len = size;
+      sqe.off = offset;
+      sqe.user_data = reinterpret_cast< unsigned long >( o );
+      _array[ index ] = index;
+      __atomic_store_n( _sq.tail, tail + 1, __ATOMIC_RELEASE );
+    }
+
+    /// the queued operations the kernel has not taken yet. called with
+    /// the mutex held.
+    unsigned pending(){
+      return *_sq.tail - __atomic_load_n( _sq.head, __ATOMIC_ACQUIRE );
+    }
+
+    /// submits up to queued operations and waits for completions. the
+    /// kernel takes no more than are queued, so concurrent calls may
+    /// count the same operations.
+    void enter( unsigned queued, unsigned completions ){
+      const unsigned flags = completions ? IORING_ENTER_GETEVENTS : 0;
+      while( ::syscall( __NR_io_uring_enter, _ring, queued, completions, flags, NULL, 0 ) < 0 && errno == EINTR ){
+      }
+    }
+
+    /// waits for the completion of o. one of the waiting threads blocks
+    /// in the kernel for the completions of all of them, and submits what
+    /// the kernel could not take before.
+    void wait( std::unique_lock< std::mutex >& guard, operation& o ){
+      while( !o.done ){
+        collect( guard );
+      }
+    }
+
+    /// takes the completions which are there, or else waits for more:
+    /// in the kernel, or for the thread which is waiting there already.
+    void collect( std::unique_lock< std::mutex >& guard ){
+      if( reap() ){
+        return;
+      }
+      if( _reaping ){
+        _completed.wait( guard );
+        return;
+      }
+      _reaping = true;
+      const unsigned queued = pending();
+      guard.unlock();
+      enter( queued, 1 );
+      guard.lock();
+      _reaping = false;
+      reap();
+      _completed.notify_all();
+    }
+
+    /// takes the completions off the queue. called with the mutex held.
+    bool reap(){
+      unsigned head = *_cq.head;
+      const unsigned tail = __atomic_load_n( _cq.tail, __ATOMIC_ACQUIRE );
+      if( head == tail ){
+        return false;
+      }
+      for( ; head != tail; ++head ){
+        const struct io_uring_cqe& cqe = _cqes[ head & *_cq.mask ];
+        operation* o = reinterpret_cast< operation* >( cqe.user_data );
+        o->result = cqe.res;
+        o->done = true;
+        --_in_flight;
+      }
+      __atomic_store_n( _cq.head, head, __ATOMIC_RELEASE );
+      _completed.notify_all();
+      return true;
+    }
+
+    ring _sq;
+    ring _cq;
+    unsigned* _array;
+    struct io_uring_sqe* _sqes;
+    struct io_uring_cqe* _cqes;
+#else
+    void queue( std::unique_lock< std::mutex >&, int fd, char* buf, size_t size, off_t offset, bool writing, operation* o ){
+      o->result = writing ? ::pwrite( fd, buf, size, offset ) : ::pread( fd, buf, size, offset );
+      o->result = o->result < 0 ? -errno : o->result;
+      o->done = true;
+    }
+
+    unsigned pending(){
+      return 0;
+    }
+
+    void enter( unsigned, unsigned ){
+    }
+
+    void wait( std::unique_lock< std::mutex >&, operation& ){
+    }
+#endif
+
+    int _ring;
+    unsigned _entries;
+    unsigned _completions;
+    /// operations queued or submitted whose completion is not reaped.
+    unsigned _in_flight;
+    /// the registered files, -1 for a free slot.
+    std::vector< int > _slots;
+    std::mutex _mutex;
+    std::condition_variable _completed;
+    bool _reaping;
+  };
+
+}
+
+#endif
+
+
+
@@ -0,0 +1,97 @@
+
+#ifndef __FUSEKIT__MEMORY_BUFFER_H
+#define __FUSEKIT__MEMORY_BUFFER_H
+
+#include <fusekit/entry.h>
+#include <fusekit/page_store.h>
+#include <fusekit/time_fields.h>
+#include <fusekit/change_log.h>
+
+namespace fusekit{
+
+  /// buffer policy keeping the content of a writable file in memory
+  /// (see page_store).
+  template< 
+    class Derived 
+    >
+  struct memory_buffer 
+    : public page_store {
+
+    int open( fuse_file_info& ){
+      return 0;
+    }
+
+    int close( fuse_file_info& ){
+      return 0;
+    }
+
+    int read( char* buf, size_t size, off_t offset, fuse_file_info& ){
+      return page_store::read( buf, size, offset );
+    }
+
+    int write( const char* buf, size_t size, off_t offset, fuse_file_info& ){
+      const int written = page_store::write( buf, size, offset );
+      if( written > 0 ){
+        change_log::instance().record( change_write );
+      }
+      return written;
+    }
+
+    int truncate( off_t size ){
+      const int err = page_store::truncate( size );
+      if( err == 0 ){
+        change_log::instance().record( change_truncate );
+      }
+      return err;
+    }
+
+    int flush( fuse_file_info& ){
+      return 0;
+    }
+
+    int fallocate( int mode, off_t offset, off_t length, fuse_file_info& ){
+      const int err = page_store::fallocate( mode, offset, length );
+      if( err == 0 ){
+        change_log::instance().record( change_write );
+      }
+      return err;
+    }
+
+    off_t lseek( off_t offset, int whence, fuse_file_info& ){
+      return page_store::seek( offset, whence );
+    }
+
+    int readlink( char*, size_t ){
+      return -EINVAL;
+    }
+
+    /// server side copy into another memory backed file: whole pages are
+    /// shared copy-on-write, so the copy costs O(pages) instead of O(bytes).
+    ssize_t copy_file_range( fuse_file_info&, off_t off_in, entry& out, fuse_file_info&, off_t off_out, size_t len, int flags ){
+      if( flags ){
+        return -EINVAL;
+      }
+      page_store* target = dynamic_cast< page_store* >( &out );
+      if( !target ){
+        return -EOPNOTSUPP;
+      }
+      const ssize_t copied = copy_to( *target, off_in, off_out, len );
+      if( copied > 0 ){
+        change_log::instance().record( change_write );
+      }
+      return copied;
+    }
+
+  protected:
+    virtual void changed( off_t bytes, blkcnt_t blocks ){
+      static_cast< Derived* >(this)->update( fusekit::modification_time | fusekit::change_time );
+      static_cast< Derived* >(this)->resized( bytes, blocks );
+    }
+  };
+
+}
+
+#endif
+
+
+
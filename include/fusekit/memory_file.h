@@ -0,0 +1,36 @@
+
+#ifndef __FUSEKIT__MEMORY_FILE_H
+#define __FUSEKIT__MEMORY_FILE_H
+
+#include <fusekit/basic_file.h>
+#include <fusekit/memory_buffer.h>
+
+namespace fusekit {
+
+  /// a regular, writable file with its content in memory.
+  template< 
+    template <class> class TimePolicy = default_time,
+    template <class> class PermissionPolicy = default_file_permissions
+    >
+  struct memory_file{
+    typedef basic_file< memory_buffer, TimePolicy, PermissionPolicy > type;
+  };
+
+  inline
+  memory_file<>::type* make_memory_file(){
+    return new memory_file<>::type;
+  }
+
+  /// creator for file factories, which lets mknod create memory files.
+  struct memory_file_creator{
+    entry* operator()(){
+      return make_memory_file();
+    }
+  };
+
+}
+
+#endif
+
+
+
@@ -0,0 +1,86 @@
+
+#ifndef __FUSEKIT__MOUNT_GROUP_H
+#define __FUSEKIT__MOUNT_GROUP_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <fusekit/daemon.h>
+
+namespace fusekit{
+
+#if FUSE_USE_VERSION > 26
+  /// serves the file systems of several daemons from one process.
+  ///
+  /// the daemons share the usage counters and their capacity (so
+  /// set_capacity is one memory budget for all mounts) and the
+  /// rcu_domain. every daemon has its own change_log and xattr_index
+  /// and reports the inodes of its own tree in statfs.
+  ///
+  /// the mounts do not share an executor: every mount is served by
+  /// threads of its own, those of its fuse loop or its worker_loop.
+  /// libfuse 3 keeps the loops of its sessions internal, so their
+  /// threads cannot serve the requests of another mount, and fusekit
+  /// does not pool the worker threads of fuse 2 either. the threads of
+  /// all mounts are bounded by the options of each mount (threads,
+  /// max_idle_threads).
+  ///
+  ///   fusekit::daemon<> assets, scratch;
+  ///   fusekit::mount_group group;
+  ///   group.add( assets, "/mnt/assets" );
+  ///   group.add( scratch, "/mnt/scratch" );
+  ///   return group.run();
+  struct mount_group {
+
+    void add( daemon_base& daemon, const std::string& mountpoint,
+              const mount_options& options = mount_options::defaults() ){
+      mount m = { &daemon, mountpoint, options, 0 };
+      _mounts.push_back( m );
+    }
+
+    /// serves all mounts until they are unmounted and returns the first
+    /// error, 0 if there was none.
+    int run(){
+      std::vector< std::thread > threads;
+      for( size_t i = 0; i < _mounts.size(); ++i ){
+        threads.push_back( std::thread( &mount_group::serve, &_mounts[i] ) );
+      }
+      int err = 0;
+      for( size_t i = 0; i < threads.size(); ++i ){
+        threads[i].join();
+        if( !err ){
+          err = _mounts[i].err;
+        }
+      }
+      return err;
+    }
+
+    /// stops all mounts.
+    void exit(){
+      for( size_t i = 0; i < _mounts.size(); ++i ){
+        _mounts[i].daemon->exit();
+      }
+    }
+
+  private:
+    struct mount {
+      daemon_base* daemon;
+      std::string mountpoint;
+      mount_options options;
+      int err;
+    };
+
+    static void serve( mount* m ){
+      m->err = m->daemon->serve( m->mountpoint.c_str(), m->options );
+    }
+
+    std::vector< mount > _mounts;
+  };
+#endif
+
+}
+
+#endif
+
+
+
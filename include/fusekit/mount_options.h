@@ -0,0 +1,319 @@
+
+#ifndef __FUSEKIT__MOUNT_OPTIONS_H
+#define __FUSEKIT__MOUNT_OPTIONS_H
+
+#include <stdio.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <fusekit/fuse.h>
+
+namespace fusekit{
+
+  /// the tuning of a mount, see daemon::run and daemon_base::serve.
+  ///
+  /// the settings are passed as mount options, and those the kernel
+  /// negotiates in the init request are applied to fuse_conn_info as
+  /// well. fuse 3 dropped most of the options, there they are applied to
+  /// fuse_conn_info and fuse_config in the init request only. zero sizes,
+  /// negative timeouts and negative async_read, parallel_dirops and
+  /// readdirplus keep the defaults of fuse, or what the options of the
+  /// command line chose for them. writeback_cache,
+  /// parallel_dirops, readdirplus and io_uring need a fuse version which
+  /// knows them, older versions ignore them.
+  ///
+  /// only defaults() is single threaded. the other presets serve the
+  /// requests from several threads, which is safe with mutex_lock as
+  /// the LockingPolicy of the daemon only. a daemon with any other
+  /// policy serializes the operations of a multithreaded loop with a
+  /// mutex of its own.
+  struct mount_options {
+    mount_options()
+      : single_threaded( false )
+      , default_permissions( false )
+      , owner( false )
+      , max_read( 0 )
+      , max_write( 0 )
+      , max_readahead( 0 )
+      , async_read( -1 )
+      , kernel_cache( false )
+      , auto_cache( false )
+      , writeback_cache( false )
+      , parallel_dirops( -1 )
+      , readdirplus( -1 )
+      , threads( 0 )
+      , pin_threads( false )
+      , clone_fd( false )
+      , max_idle_threads( 0 )
+      , io_uring( false )
+      , io_uring_queue_depth( 0 )
+      , entry_timeout( -1 )
+      , attr_timeout( -1 )
+      , negative_timeout( -1 ){
+    }
+
+    /// the options daemon::run used to add: one operation at a time,
+    /// permissions checked by the kernel, files owned by the process.
+    static mount_options defaults(){
+      mount_options o;
+      o.single_threaded = true;
+      o.default_permissions = true;
+      o.owner = true;
+      return o;
+    }
+
+    /// large sequential transfers: big requests, deep readahead, cached
+    /// pages and attributes, writes collected by the kernel.
+    static mount_options throughput(){
+      mount_options o;
+      o.default_permissions = true;
+      o.owner = true;
+      o.max_read = 128 * 1024;
+      o.max_write = 128 * 1024;
+      o.max_readahead = 1024 * 1024;
+      o.kernel_cache = true;
+      o.writeback_cache = true;
+      o.entry_timeout = 60;
+      o.attr_timeout = 60;
+      o.negative_timeout = 10;
+      return o;
+    }
+
+    /// small requests answered quickly: little readahead, so a small
+    /// read is not stretched to a large one, cached pages kept as long
+    /// as the file does not change, short attribute timeouts, so
+    /// changes are visible soon.
+    static mount_options latency(){
+      mount_options o;
+      o.default_permissions = true;
+      o.owner = true;
+      o.max_readahead = 16 * 1024;
+      o.auto_cache = true;
+      o.entry_timeout = 1;
+      o.attr_timeout = 1;
+      o.negative_timeout = 1;
+      return o;
+    }
+
+    /// appends the settings as command line arguments of fuse.
+    void append( std::vector< std::string >& args ) const {
+      if( single_threaded ){
+        args.push_back( "-s" );
+      }
+      std::vector< std::string > options;
+      if( default_permissions ){
+        options.push_back( "default_permissions" );
+      }
+      if( max_read ){
+        options.push_back( number( "max_read=%.0f", max_read ) );
+      }
+#if FUSE_USE_VERSION >= 30
+      if( clone_fd ){
+        options.push_back( "clone_fd" );
+      }
+      if( max_idle_threads ){
+        options.push_back( number( "max_idle_threads=%.0f", max_idle_threads ) );
+      }
+#ifdef FUSE_CAP_OVER_IO_URING
+      if( io_uring && io_uring_enabled() ){
+        options.push_back( "io_uring" );
+        if( io_uring_queue_depth ){
+          options.push_back( number( "io_uring_q_depth=%.0f", io_uring_queue_depth ) );
+        }
+      }
+#endif
+#else
+      if( owner ){
+        options.push_back( number( "uid=%.0f", ::getuid() ) );
+        options.push_back( number( "gid=%.0f", ::getgid() ) );
+      }
+      if( max_write ){
+        options.push_back( number( "max_write=%.0f", max_write ) );
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(2, 8)
+        if( max_write > 4096 ){
+          options.push_back( "big_writes" );
+        }
+#endif
+      }
+      if( max_readahead ){
+        options.push_back( number( "max_readahead=%.0f", max_readahead ) );
+      }
+      if( async_read >= 0 ){
+        options.push_back( async_read ? "async_read" : "sync_read" );
+      }
+      if( kernel_cache ){
+        options.push_back( "kernel_cache" );
+      }
+      if( auto_cache ){
+        options.push_back( "auto_cache" );
+      }
+      if( entry_timeout >= 0 ){
+        options.push_back( number( "entry_timeout=%g", entry_timeout ) );
+      }
+      if( attr_timeout >= 0 ){
+        options.push_back( number( "attr_timeout=%g", attr_timeout ) );
+      }
+      if( negative_timeout >= 0 ){
+        options.push_back( number( "negative_timeout=%g", negative_timeout ) );
+      }
+#endif
+      for( size_t i = 0; i < options.size(); ++i ){
+        args.push_back( "-o" );
+        args.push_back( options[i] );
+      }
+    }
+
+#if FUSE_USE_VERSION > 26
+    /// applies the settings negotiated in the init request.
+    void apply( struct fuse_conn_info& conn ) const {
+      if( max_write && max_write < conn.max_write ){
+        conn.max_write = max_write;
+      }
+      if( max_readahead && max_readahead < conn.max_readahead ){
+        conn.max_readahead = max_readahead;
+      }
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(2, 8)
+      want( conn, FUSE_CAP_ASYNC_READ, async_read );
+#if FUSE_VERSION < FUSE_MAKE_VERSION(3, 0)
+      want( conn, FUSE_CAP_BIG_WRITES, max_write > 4096 );
+#endif
+#endif
+#ifdef FUSE_CAP_WRITEBACK_CACHE
+      want( conn, FUSE_CAP_WRITEBACK_CACHE, writeback_cache );
+#endif
+#ifdef FUSE_CAP_PARALLEL_DIROPS
+      want( conn, FUSE_CAP_PARALLEL_DIROPS, parallel_dirops );
+#endif
+#ifdef FUSE_CAP_READDIRPLUS
+      want( conn, FUSE_CAP_READDIRPLUS, readdirplus );
+#endif
+#ifdef FUSE_CAP_OVER_IO_URING
+      // beyond the 32 bits of want
+      if( io_uring && io_uring_enabled() ){
+        fuse_set_feature_flag( &conn, FUSE_CAP_OVER_IO_URING );
+      }
+      else{
+        fuse_unset_feature_flag( &conn, FUSE_CAP_OVER_IO_URING );
+      }
+#endif
+    }
+#endif
+
+#if FUSE_USE_VERSION >= 30
+    /// applies the settings fuse 3 takes from the init handler.
+    void apply( struct fuse_conn_info& conn, struct fuse_config& config ) const {
+      apply( conn );
+      if( owner ){
+        config.set_uid = 1;
+        config.uid = ::getuid();
+        config.set_gid = 1;
+        config.gid = ::getgid();
+      }
+      // enabled only, so the options of the command line are kept
+      if( kernel_cache ){
+        config.kernel_cache = 1;
+      }
+      if( auto_cache ){
+        config.auto_cache = 1;
+      }
+      if( entry_timeout >= 0 ){
+        config.entry_timeout = entry_timeout;
+      }
+      if( attr_timeout >= 0 ){
+        config.attr_timeout = attr_timeout;
+      }
+      if( negative_timeout >= 0 ){
+        config.negative_timeout = negative_timeout;
+      }
+    }
+#endif
+
+    bool single_threaded;
+    bool default_permissions;
+    /// uid and gid of the process as owner of all files.
+    bool owner;
+    unsigned max_read;
+    unsigned max_write;
+    unsigned max_readahead;
+    /// reads of a file are sent to the daemon concurrently.
+    int async_read;
+    /// keeps the page cache on open, for content which changes only
+    /// through the mount.
+    bool kernel_cache;
+    /// keeps the page cache on open if size and modification time did
+    /// not change.
+    bool auto_cache;
+    bool writeback_cache;
+    /// lookups and readdir of a directory run concurrently.
+    int parallel_dirops;
+    /// readdir returns the attributes of the children, which saves a
+    /// lookup per child.
+    int readdirplus;
+    /// the worker threads of the loop of daemon_base::serve (see
+    /// worker_loop), 0 runs the multithreaded loop of fuse instead.
+    /// needs fuse 2.9.
+    unsigned threads;
+    /// binds every worker thread to a cpu (linux only), needs threads.
+    bool pin_threads;
+    /// a device file per worker thread of the loop. fuse 3 clones them
+    /// in its own loop only, so serve rejects clone_fd with threads there.
+    bool clone_fd;
+    /// the idle worker threads of the loop of fuse, 0 keeps the default
+    /// of fuse (fuse 3 only).
+    unsigned max_idle_threads;
+    /// the kernel delivers the requests over io_uring queues, one per
+    /// cpu, instead of reads and writes of the device file: a system
+    /// call less per request. needs fuse 3.18 and a kernel with the
+    /// enable_uring parameter of the fuse module set, without them the
+    /// device file is read as usual.
+    bool io_uring;
+    /// the requests per queue, 0 keeps the default of fuse.
+    unsigned io_uring_queue_depth;
+    /// seconds names, attributes and missing names are cached.
+    double entry_timeout;
+    double attr_timeout;
+    double negative_timeout;
+
+    /// true if the kernel offers fuse over io_uring.
+    static bool io_uring_enabled(){
+      FILE* f = ::fopen( "/sys/module/fuse/parameters/enable_uring", "r" );
+      if( !f ){
+        return false;
+      }
+      const int c = ::fgetc( f );
+      ::fclose( f );
+      return c == 'Y' || c == '1';
+    }
+
+  private:
+    static std::string number( const char* format, double value ){
+      char buffer[64];
+      ::snprintf( buffer, sizeof(buffer), format, value );
+      return buffer;
+    }
+
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(2, 8)
+    static void want( struct fuse_conn_info& conn, unsigned capability, bool on ){
+      if( on && conn.capable & capability ){
+        conn.want |= capability;
+      }
+      else if( !on ){
+        conn.want &= ~capability;
+      }
+    }
+
+    /// like want, a negative setting keeps the capability as negotiated.
+    static void want( struct fuse_conn_info& conn, unsigned capability, int setting ){
+      if( setting >= 0 ){
+        want( conn, capability, setting != 0 );
+      }
+    }
+#endif
+  };
+
+}
+
+#endif
+
+
+
@@ -0,0 +1,31 @@
+#ifndef __FUSEKIT__MUTEX_LOCK_H
+#define __FUSEKIT__MUTEX_LOCK_H
+
+#include <mutex>
+
+namespace fusekit{
+
+  /// locking policy which serializes the operations with a mutex.
+  ///
+  /// as LockingPolicy of the daemon it makes any tree safe for the
+  /// multithreaded loops, at the price of running one operation at a
+  /// time. it is the only policy which does. the file systems still
+  /// gain from the threads: the kernel keeps several requests in flight
+  /// and the transfers overlap.
+  struct mutex_lock {
+    static const bool serializes = true;
+
+    struct lock{
+      lock( mutex_lock& l )
+        : _guard( l._mutex ){
+      }
+    private:
+      std::lock_guard< std::mutex > _guard;
+    };
+
+  private:
+    std::mutex _mutex;
+  };
+}
+
+#endif
@@ -39,6 +39,22 @@ namespace fusekit{
       return -EISDIR;
     }
 
+    blkcnt_t blocks(){
+      return 0;
+    }
+
+    off_t lseek( off_t, int, fuse_file_info& ){
+      return -EISDIR;
+    }
+
+    int fallocate( int, off_t, off_t, fuse_file_info& ){
+      return -EISDIR;
+    }
+
+    ssize_t copy_file_range( fuse_file_info&, off_t, entry&, fuse_file_info&, off_t, size_t, int ){
+      return -EISDIR;
+    }
+
     int readlink( char*, size_t ){
       return -EINVAL;
     }
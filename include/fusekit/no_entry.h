@@ -38,7 +38,7 @@ namespace fusekit{
     virtual int opendir( fuse_file_info& ){
       return -ENOENT;
     }
-    virtual int readdir( void*, fuse_fill_dir_t, off_t, fuse_file_info& ){
+    virtual int readdir( void*, fill_dir_t, off_t, fuse_file_info& ){
       return -ENOENT;
     }
     virtual int releasedir( fuse_file_info& ){
@@ -83,6 +83,65 @@ namespace fusekit{
     virtual int removexattr( const char * ){
       return -ENOENT;
     }
+    virtual int freeze( bool ){
+      return -ENOENT;
+    }
+    virtual int rename( const char*, entry&, const char*, unsigned int ){
+      return -ENOENT;
+    }
+    virtual int attach( const char*, entry* ){
+      return -ENOENT;
+    }
+    virtual entry* detach( const char* ){
+      return 0;
+    }
+    virtual int link( const char*, entry& ){
+      return -ENOENT;
+    }
+    virtual int hold(){
+      return -ENOENT;
+    }
+    virtual int drop(){
+      return 1;
+    }
+    virtual int scan( const std::string&, child_visitor& ){
+      return -ENOENT;
+    }
+    virtual subtree_size subtree(){
+      return subtree_size();
+    }
+    virtual subtree_size adopted( entry* ){
+      return subtree_size();
+    }
+    virtual subtree_size orphaned( entry* ){
+      return subtree_size();
+    }
+    virtual void add_subtree( const subtree_size& ){
+    }
+    virtual unsigned long generation(){
+      return 0;
+    }
+    virtual off_t lseek( off_t, int, fuse_file_info& ){
+      return -ENOENT;
+    }
+    virtual int fallocate( int, off_t, off_t, fuse_file_info& ){
+      return -ENOENT;
+    }
+    virtual ssize_t copy_file_range( fuse_file_info&, off_t, entry&, fuse_file_info&, off_t, size_t, int ){
+      return -ENOENT;
+    }
+    virtual int fstat( struct stat&, fuse_file_info& ){
+      return -ENOENT;
+    }
+    virtual int ftruncate( off_t, fuse_file_info& ){
+      return -ENOENT;
+    }
+    virtual int fchmod( mode_t, fuse_file_info& ){
+      return -ENOENT;
+    }
+    virtual int ioctl( unsigned int, void*, fuse_file_info& ){
+      return -ENOENT;
+    }
   };
 }
 
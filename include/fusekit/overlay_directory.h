@@ -0,0 +1,383 @@
+
+#ifndef __FUSEKIT__OVERLAY_DIRECTORY_H
+#define __FUSEKIT__OVERLAY_DIRECTORY_H
+
+#include <string.h>
+#include <sys/stat.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fusekit/entry.h>
+#include <fusekit/child_index.h>
+#include <fusekit/reclaim.h>
+#include <fusekit/virtual_node.h>
+#include <fusekit/basic_directory.h>
+
+namespace fusekit{
+
+  /// node policy of a directory layering other directories, e.g. static
+  /// assets, generated reports and a scratch space under one root.
+  ///
+  /// find resolves a name in the layers in order of priority, the first
+  /// one is the upper layer. a directory found in a lower layer is an
+  /// overlay again, of the directories with that name in all layers, so
+  /// the layers are merged recursively. readdir merges the names of all
+  /// layers. creations go to the upper layer, missing directories of the
+  /// upper layer are created on the way. entries of lower layers cannot
+  /// be removed or renamed (there are no whiteouts): -EROFS.
+  ///
+  /// the lookups and the listing are cached. the cache is stamped with
+  /// the generations of the layers (see entry::generation) and dropped
+  /// as soon as one of them changes, so a lookup in a deep overlay costs
+  /// one generation check per layer and a map lookup. layers which
+  /// cannot tell their generation are not cached. dropped overlays are
+  /// retired (see reclaim), like the directories of a virtual_cache.
+  template<
+    class Derived
+    >
+  struct overlay_node
+    : public virtual_node {
+
+    overlay_node()
+      : _owned( false )
+      , _parent( 0 )
+      , _directories( 0 )
+      , _listed( false ){
+    }
+
+    ~overlay_node(){
+      clear( false );
+      if( _owned ){
+        for( size_t i = 0; i < _layers.size(); ++i ){
+          delete _layers[i];
+        }
+      }
+    }
+
+    /// the layers, the upper one first. the overlay deletes them.
+    void bind( const std::vector< entry* >& layers ){
+      _layers = layers;
+      _owned = true;
+    }
+
+    entry* find( const char* name ){
+      std::lock_guard< std::mutex > guard( _mutex );
+      const bool cached = validate();
+      if( cached ){
+        lookups_t::const_iterator i = _lookups.find( name );
+        if( i != _lookups.end() ){
+          return i->second;
+        }
+      }
+      entry* e = resolve( name );
+      if( cached ){
+        _lookups[ name ] = e;
+      }
+      return e;
+    }
+
+    /// 2 + the directories among the merged children.
+    int links(){
+      std::lock_guard< std::mutex > guard( _mutex );
+      listing();
+      return _directories + 2;
+    }
+
+    int readdir( void* buf, fill_dir_t filler, off_t offset, fuse_file_info& ){
+      std::vector< std::string > names;
+      {
+        std::lock_guard< std::mutex > guard( _mutex );
+        names = listing();
+      }
+      filler( buf, ".", NULL, offset );
+      filler( buf, "..", NULL, offset );
+      for( size_t i = 0; i < names.size(); ++i ){
+        filler( buf, names[i].c_str(), NULL, offset );
+      }
+      return 0;
+    }
+
+    int scan( const std::string& prefix, child_visitor& visitor ){
+      std::vector< std::string > names;
+      {
+        std::lock_guard< std::mutex > guard( _mutex );
+        names = listing();
+      }
+      std::vector< std::string >::const_iterator i = std::lower_bound( names.begin(), names.end(), prefix );
+      for( ; i != names.end() && i->compare( 0, prefix.size(), prefix ) == 0; ++i ){
+        entry* e = find( i->c_str() );
+        if( e ){
+          visitor( *i, e );
+        }
+      }
+      return 0;
+    }
+
+    int mknod( const char* name, mode_t mode, dev_t type ){
+      if( find( name ) ){
+        return -EEXIST;
+      }
+      entry* u = upper( true );
+      return u ? u->mknod( name, mode, type ) : -EROFS;
+    }
+
+    int mkdir( const char* name, mode_t mode ){
+      if( find( name ) ){
+        return -EEXIST;
+      }
+      entry* u = upper( true );
+      return u ? u->mkdir( name, mode ) : -EROFS;
+    }
+
+    int symlink( const char* name, const char* target ){
+      if( find( name ) ){
+        return -EEXIST;
+      }
+      entry* u = upper( true );
+      return u ? u->symlink( name, target ) : -EROFS;
+    }
+
+    int unlink( const char* name ){
+      entry* u = upper_child( name );
+      return u ? u->unlink( name ) : lower_error( name );
+    }
+
+    int rmdir( const char* name ){
+      entry* u = upper_child( name );
+      return u ? u->rmdir( name ) : lower_error( name );
+    }
+
+    /// renames within the upper layers.
+    int rename( const char* name, entry& newparent, const char* newname, unsigned int flags ){
+      entry* u = upper_child( name );
+      if( !u ){
+        return lower_error( name );
+      }
+      Derived* overlay = dynamic_cast< Derived* >( &newparent );
+      entry* target = overlay ? overlay->upper( true ) : &newparent;
+      return target ? u->rename( name, *target, newname, flags ) : -EROFS;
+    }
+
+    int attach( const char* name, entry* child ){
+      entry* u = upper( true );
+      return u ? u->attach( name, child ) : -EROFS;
+    }
+
+    entry* detach( const char* name ){
+      entry* u = upper_child( name );
+      return u ? u->detach( name ) : 0;
+    }
+
+    int link( const char* name, entry& target ){
+      if( find( name ) ){
+        return -EEXIST;
+      }
+      entry* u = upper( true );
+      return u ? u->link( name, target ) : -EROFS;
+    }
+
+    /// the directory of the upper layer, created if create is set.
+    entry* upper( bool create ){
+      if( _owned || _layers.empty() ){
+        return _layers.empty() ? 0 : _layers[0];
+      }
+      entry* parent = _parent->upper( create );
+      if( !parent ){
+        return 0;
+      }
+      entry* u = parent->child( _name.c_str() );
+      if( !u && create && parent->mkdir( _name.c_str(), 0755 ) == 0 ){
+        u = parent->child( _name.c_str() );
+      }
+      return u;
+    }
+
+  private:
+    typedef std::map< std::string, entry* > lookups_t;
+    typedef std::map< std::string, Derived* > nested_t;
+
+    /// checks the stamp of the cache, drops the cache if it is outdated.
+    /// false if the layers cannot be cached.
+    bool validate(){
+      std::vector< unsigned long > stamp( _layers.size() );
+      bool cacheable = true;
+      for( size_t i = 0; i < _layers.size(); ++i ){
+        stamp[i] = _layers[i] ? _layers[i]->generation() : missing;
+        cacheable = cacheable && stamp[i] != 0;
+      }
+      if( !cacheable ){
+        // the nested overlays are kept, resolve checks their layers
+        _lookups.clear();
+        _listed = false;
+        _stamp.clear();
+      }
+      else if( stamp != _stamp ){
+        clear( true );
+        _stamp = stamp;
+      }
+      return cacheable;
+    }
+
+    /// the entry of the first layer containing name. a directory of a
+    /// lower layer is merged with the directories of the layers below.
+    entry* resolve( const char* name ){
+      std::vector< entry* > layers( _layers.size() );
+      size_t found = _layers.size();
+      for( size_t i = 0; i < _layers.size(); ++i ){
+        layers[i] = _layers[i] ? _layers[i]->child( name ) : 0;
+        if( layers[i] && found == _layers.size() ){
+          found = i;
+        }
+      }
+      if( found == _layers.size() ){
+        return 0;
+      }
+      if( !is_directory( *layers[ found ] ) || ( found == 0 && !lower_directory( layers ) ) ){
+        return layers[ found ];
+      }
+      for( size_t i = found + 1; i < layers.size(); ++i ){
+        if( layers[i] && !is_directory( *layers[i] ) ){
+          // hidden by the directory above
+          layers[i] = 0;
+        }
+      }
+      typename nested_t::iterator n = _nested.find( name );
+      if( n != _nested.end() ){
+        if( n->second->_layers == layers ){
+          return n->second;
+        }
+        reclaim::retire( n->second );
+        _nested.erase( n );
+      }
+      Derived* nested = new Derived;
+      nested->_layers = layers;
+      nested->_parent = this;
+      nested->_name = name;
+      _nested[ name ] = nested;
+      return nested;
+    }
+
+    /// the merged names of all layers, sorted. counts the directories
+    /// among them, a name is a directory if it is one in the first layer
+    /// containing it.
+    const std::vector< std::string >& listing(){
+      if( !validate() || !_listed ){
+        names_t names;
+        name_collector collector( names );
+        for( size_t i = 0; i < _layers.size(); ++i ){
+          if( _layers[i] ){
+            _layers[i]->scan( "", collector );
+          }
+        }
+        _listing.clear();
+        _directories = 0;
+        for( names_t::const_iterator i = names.begin(); i != names.end(); ++i ){
+          _listing.push_back( i->first );
+          _directories += i->second;
+        }
+        _listed = true;
+      }
+      return _listing;
+    }
+
+    /// drops the cached lookups and listing. the nested overlays are
+    /// retired, operations running in them may still use them.
+    void clear( bool retire ){
+      typename nested_t::const_iterator i = _nested.begin();
+      for( ; i != _nested.end(); ++i ){
+        if( retire ){
+          reclaim::retire( i->second );
+        }
+        else{
+          delete i->second;
+        }
+      }
+      _nested.clear();
+      _lookups.clear();
+      _listing.clear();
+      _directories = 0;
+      _listed = false;
+    }
+
+    /// the upper directory, if it contains name.
+    entry* upper_child( const char* name ){
+      entry* u = upper( false );
+      return u && u->child( name ) ? u : 0;
+    }
+
+    int lower_error( const char* name ){
+      return find( name ) ? -EROFS : -ENOENT;
+    }
+
+    static bool lower_directory( const std::vector< entry* >& layers ){
+      for( size_t i = 1; i < layers.size(); ++i ){
+        if( layers[i] && is_directory( *layers[i] ) ){
+          return true;
+        }
+      }
+      return false;
+    }
+
+    static bool is_directory( entry& e ){
+      struct stat st;
+      ::memset( &st, 0, sizeof(st) );
+      e.stat( st );
+      return S_ISDIR( st.st_mode );
+    }
+
+    /// the names and whether they are directories.
+    typedef std::map< std::string, bool > names_t;
+
+    /// keeps the entry of the first layer scanned for a name.
+    struct name_collector : public child_visitor {
+      explicit name_collector( names_t& n )
+        : names( n ){
+      }
+      void operator()( const std::string& name, entry* child ){
+        names_t::iterator i = names.lower_bound( name );
+        if( i == names.end() || i->first != name ){
+          names.insert( i, std::make_pair( name, child && is_directory( *child ) ) );
+        }
+      }
+      names_t& names;
+    };
+
+    /// the stamp of a layer without a directory at this level.
+    static const unsigned long missing = ~0UL;
+
+    std::vector< entry* > _layers;
+    bool _owned;
+    /// the overlay and the name this one was resolved from.
+    overlay_node* _parent;
+    std::string _name;
+
+    std::mutex _mutex;
+    std::vector< unsigned long > _stamp;
+    lookups_t _lookups;
+    /// the overlays of the directories of lower layers.
+    nested_t _nested;
+    std::vector< std::string > _listing;
+    size_t _directories;
+    bool _listed;
+  };
+
+  typedef basic_directory< overlay_node > overlay_directory;
+
+  /// an overlay of layers, the upper (writable) one first:
+  /// root.add_directory( "merged", make_overlay_directory( layers ) );
+  /// the overlay takes ownership of the layers.
+  inline
+  overlay_directory* make_overlay_directory( const std::vector< entry* >& layers ){
+    overlay_directory* o = new overlay_directory;
+    o->bind( layers );
+    return o;
+  }
+
+}
+
+#endif
+
+
+
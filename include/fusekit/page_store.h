@@ -0,0 +1,437 @@
+
+#ifndef __FUSEKIT__PAGE_STORE_H
+#define __FUSEKIT__PAGE_STORE_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <map>
+#include <mutex>
+#include <algorithm>
+#include <tr1/memory>
+#include <fusekit/usage.h>
+
+#ifndef SEEK_DATA
+#define SEEK_DATA 3
+#endif
+#ifndef SEEK_HOLE
+#define SEEK_HOLE 4
+#endif
+#ifndef FALLOC_FL_KEEP_SIZE
+#define FALLOC_FL_KEEP_SIZE 0x01
+#endif
+#ifndef FALLOC_FL_PUNCH_HOLE
+#define FALLOC_FL_PUNCH_HOLE 0x02
+#endif
+#ifndef FALLOC_FL_ZERO_RANGE
+#define FALLOC_FL_ZERO_RANGE 0x10
+#endif
+
+namespace fusekit{
+
+  /// the content of a memory backed file, stored in fixed size pages.
+  ///
+  /// pages are reference counted and may be shared between stores:
+  /// copying page aligned ranges (copy_to) shares the pages instead of
+  /// copying the bytes, and a shared page is copied when one of the
+  /// stores writes to it. a page which has never been written is a hole,
+  /// it reads as zeros and does not occupy memory. the pages are kept in
+  /// a map by their number, so holes cost nothing, however large the
+  /// file. holes are reported by blocks and seek, which skips from one
+  /// allocated page to the next.
+  ///
+  /// page_store is not a template, so stores of different file types
+  /// find each other by dynamic_cast from their entries.
+  struct page_store {
+    enum { page_size = 4096 };
+
+    page_store()
+      : _size( 0 ){
+    }
+
+    virtual ~page_store(){
+    }
+
+    int read( char* buf, size_t size, off_t offset ){
+      std::lock_guard< std::mutex > guard( _mutex );
+      return read_at( buf, size, offset );
+    }
+
+    int write( const char* buf, size_t size, off_t offset ){
+      extent before;
+      extent after;
+      {
+        std::lock_guard< std::mutex > guard( _mutex );
+        const int err = check_storage( offset, offset + size, true );
+        if( err ){
+          return err;
+        }
+        before = current();
+        write_at( buf, size, offset );
+        after = current();
+      }
+      changed( after.size - before.size, after.blocks - before.blocks );
+      return size;
+    }
+
+    int truncate( off_t size ){
+      if( size < 0 ){
+        return -EINVAL;
+      }
+      extent before;
+      extent after;
+      {
+        std::lock_guard< std::mutex > guard( _mutex );
+        before = current();
+        resize( size );
+        after = current();
+      }
+      changed( after.size - before.size, after.blocks - before.blocks );
+      return 0;
+    }
+
+    /// fallocate(2) on the range [offset,offset+length).
+    ///
+    /// without flags, the pages of the range are allocated up front (and
+    /// the size is extended unless FALLOC_FL_KEEP_SIZE is given), so later
+    /// writes into the range do not allocate. FALLOC_FL_PUNCH_HOLE releases
+    /// the pages which are completely inside the range and zeroes the rest,
+    /// FALLOC_FL_ZERO_RANGE does the same but may extend the size.
+    int fallocate( int mode, off_t offset, off_t length ){
+      if( offset < 0 || length <= 0 ){
+        return -EINVAL;
+      }
+      if( mode & ~( FALLOC_FL_KEEP_SIZE | FALLOC_FL_PUNCH_HOLE | FALLOC_FL_ZERO_RANGE ) ){
+        return -EOPNOTSUPP;
+      }
+      if( ( mode & FALLOC_FL_PUNCH_HOLE ) && ( mode & FALLOC_FL_ZERO_RANGE ) ){
+        return -EINVAL;
+      }
+      if( ( mode & FALLOC_FL_PUNCH_HOLE ) && !( mode & FALLOC_FL_KEEP_SIZE ) ){
+        return -EOPNOTSUPP;
+      }
+      extent before;
+      extent after;
+      {
+        std::lock_guard< std::mutex > guard( _mutex );
+        before = current();
+        const off_t end = offset + length;
+        if( mode & ( FALLOC_FL_PUNCH_HOLE | FALLOC_FL_ZERO_RANGE ) ){
+          release( offset, std::min( end, _size ) );
+        }
+        else{
+          const int err = check_storage( offset, end, false );
+          if( err ){
+            return err;
+          }
+          reserve( offset, end );
+        }
+        if( !( mode & FALLOC_FL_KEEP_SIZE ) && end > _size ){
+          _size = end;
+        }
+        after = current();
+      }
+      changed( after.size - before.size, after.blocks - before.blocks );
+      return 0;
+    }
+
+    off_t size(){
+      std::lock_guard< std::mutex > guard( _mutex );
+      return _size;
+    }
+
+    /// the allocated storage in 512 byte blocks, as st_blocks of stat(2).
+    /// holes do not count, so sparse aware tools can detect them.
+    blkcnt_t blocks(){
+      std::lock_guard< std::mutex > guard( _mutex );
+      return current().blocks;
+    }
+
+    /// lseek(2) with SEEK_DATA or SEEK_HOLE: the start of the first data
+    /// (or hole) at or behind offset. the end of the file counts as hole.
+    /// a hole has page granularity, as pages are either allocated or not.
+    off_t seek( off_t offset, int whence ){
+      std::lock_guard< std::mutex > guard( _mutex );
+      if( whence != SEEK_DATA && whence != SEEK_HOLE ){
+        return -EINVAL;
+      }
+      if( offset < 0 || offset >= _size ){
+        return -ENXIO;
+      }
+      off_t p = offset / page_size;
+      pages_t::const_iterator i = _pages.lower_bound( p );
+      if( whence == SEEK_DATA ){
+        if( i == _pages.end() || i->first * page_size >= _size ){
+          return -ENXIO;
+        }
+        return std::max< off_t >( offset, i->first * page_size );
+      }
+      for( ; i != _pages.end() && i->first == p; ++i ){
+        ++p;
+      }
+      return std::min( _size, std::max< off_t >( offset, p * page_size ) );
+    }
+
+    /// copies len bytes at offset in to offset out of target. pages which
+    /// are completely covered on both sides are shared, not copied.
+    /// returns the number of bytes copied or -errno.
+    ssize_t copy_to( page_store& target, off_t in, off_t out, size_t len ){
+      if( in < 0 || out < 0 ){
+        return -EINVAL;
+      }
+      ssize_t copied = 0;
+      extent before;
+      extent after;
+      if( &target == this ){
+        if( in < out + static_cast< off_t >( len ) && out < in + static_cast< off_t >( len ) ){
+          return -EINVAL;
+        }
+        std::lock_guard< std::mutex > guard( _mutex );
+        before = current();
+        copied = copy_locked( *this, in, out, len );
+        after = current();
+      }
+      else{
+        std::unique_lock< std::mutex > source_guard( _mutex, std::defer_lock );
+        std::unique_lock< std::mutex > target_guard( target._mutex, std::defer_lock );
+        std::lock( source_guard, target_guard );
+        before = target.current();
+        copied = copy_locked( target, in, out, len );
+        after = target.current();
+      }
+      if( copied > 0 ){
+        target.changed( after.size - before.size, after.blocks - before.blocks );
+      }
+      return copied;
+    }
+
+  protected:
+    /// called after the content or the size has been changed, with the
+    /// change of the size and of the blocks. the store is not locked, so
+    /// it may be queried.
+    virtual void changed( off_t, blkcnt_t ){
+    }
+
+  private:
+    /// the size and the blocks of the store.
+    struct extent {
+      off_t size;
+      blkcnt_t blocks;
+    };
+
+    /// requires _mutex to be held.
+    extent current() const {
+      extent e;
+      e.size = _size;
+      e.blocks = _pages.size() * ( page_size / 512 );
+      return e;
+    }
+
+    /// pages account for the storage they occupy (see usage).
+    struct page {
+      page(){
+        ::memset( data, 0, page_size );
+        usage::instance().add_bytes( page_size );
+      }
+      page( const page& other ){
+        ::memcpy( data, other.data, page_size );
+        usage::instance().add_bytes( page_size );
+      }
+      ~page(){
+        usage::instance().add_bytes( -static_cast< long long >( page_size ) );
+      }
+      char data[ page_size ];
+    private:
+      page& operator=( const page& );
+    };
+    typedef std::tr1::shared_ptr< page > page_ptr;
+    typedef std::map< off_t, page_ptr > pages_t;
+
+    page_store( const page_store& );
+    page_store& operator=( const page_store& );
+
+    int read_at( char* buf, size_t size, off_t offset ) const {
+      if( offset < 0 ){
+        return -EINVAL;
+      }
+      if( offset >= _size ){
+        return 0;
+      }
+      size = std::min< off_t >( size, _size - offset );
+      const off_t end = offset + size;
+      off_t done = offset;
+      pages_t::const_iterator i = _pages.lower_bound( offset / page_size );
+      for( ; i != _pages.end() && i->first * page_size < end; ++i ){
+        const off_t begin = std::max< off_t >( offset, i->first * page_size );
+        const off_t stop = std::min< off_t >( end, ( i->first + 1 ) * page_size );
+        // holes read as zeros
+        ::memset( buf + ( done - offset ), 0, begin - done );
+        ::memcpy( buf + ( begin - offset ), i->second->data + begin % page_size, stop - begin );
+        done = stop;
+      }
+      ::memset( buf + ( done - offset ), 0, end - done );
+      return size;
+    }
+
+    void write_at( const char* buf, size_t size, off_t offset ){
+      size_t done = 0;
+      while( done < size ){
+        const off_t p = ( offset + done ) / page_size;
+        const size_t o = ( offset + done ) % page_size;
+        const size_t n = std::min< size_t >( page_size - o, size - done );
+        ::memcpy( writable( p ).data + o, buf + done, n );
+        done += n;
+      }
+      _size = std::max< off_t >( _size, offset + size );
+    }
+
+    void resize( off_t size ){
+      const off_t count = ( size + page_size - 1 ) / page_size;
+      _pages.erase( _pages.lower_bound( count ), _pages.end() );
+      const size_t tail = size % page_size;
+      if( tail && _pages.count( count - 1 ) ){
+        // bytes behind the end have to read as zeros when the file grows again
+        ::memset( writable( count - 1 ).data + tail, 0, page_size - tail );
+      }
+      _size = size;
+    }
+
+    /// replaces the page p, null turns it into a hole.
+    void assign( off_t p, const page_ptr& value ){
+      if( value ){
+        _pages[p] = value;
+      }
+      else{
+        _pages.erase( p );
+      }
+    }
+
+    /// -ENOSPC if the pages of [begin,end) which have to be allocated
+    /// (or unshared, if writing) exceed the capacity.
+    int check_storage( off_t begin, off_t end, bool writing ) const {
+      if( begin >= end ){
+        return 0;
+      }
+      const off_t first = begin / page_size;
+      const off_t last = ( end + page_size - 1 ) / page_size;
+      unsigned long long needed = last - first;
+      pages_t::const_iterator i = _pages.lower_bound( first );
+      for( ; i != _pages.end() && i->first < last; ++i ){
+        if( !writing || i->second.unique() ){
+          --needed;
+        }
+      }
+      return needed ? usage::instance().check_bytes( needed * page_size ) : 0;
+    }
+
+    /// allocates the pages of [begin,end).
+    void reserve( off_t begin, off_t end ){
+      const off_t last = ( end + page_size - 1 ) / page_size;
+      pages_t::iterator i = _pages.lower_bound( begin / page_size );
+      for( off_t p = begin / page_size; p < last; ++p ){
+        if( i != _pages.end() && i->first == p ){
+          ++i;
+        }
+        else{
+          _pages.insert( i, std::make_pair( p, page_ptr( new page() ) ) );
+        }
+      }
+    }
+
+    /// turns [begin,end) into a hole: whole pages are released,
+    /// partially covered ones are zeroed.
+    void release( off_t begin, off_t end ){
+      if( begin >= end ){
+        return;
+      }
+      pages_t::iterator i = _pages.lower_bound( begin / page_size );
+      while( i != _pages.end() && i->first * page_size < end ){
+        const off_t first = i->first * page_size;
+        const off_t from = std::max( begin, first );
+        const off_t to = std::min< off_t >( end, first + page_size );
+        if( from == first && to - from == page_size ){
+          _pages.erase( i++ );
+        }
+        else{
+          ::memset( writable( i->first ).data + from % page_size, 0, to - from );
+          ++i;
+        }
+      }
+    }
+
+    /// the page p, allocated or unshared if necessary.
+    page& writable( off_t p ){
+      pages_t::iterator i = _pages.lower_bound( p );
+      if( i == _pages.end() || i->first != p ){
+        i = _pages.insert( i, std::make_pair( p, page_ptr( new page() ) ) );
+      }
+      else if( !i->second.unique() ){
+        i->second.reset( new page( *i->second ) );
+      }
+      return *i->second;
+    }
+
+    /// requires the locks of both stores.
+    ssize_t copy_locked( page_store& target, off_t in, off_t out, size_t len ){
+      if( in >= _size || len == 0 ){
+        return 0;
+      }
+      len = std::min< off_t >( len, _size - in );
+      // only the bytes which are not shared page by page take storage
+      const bool aligned = in % page_size == out % page_size;
+      const size_t head = aligned
+        ? std::min< size_t >( len, ( page_size - in % page_size ) % page_size )
+        : len;
+      const size_t tail = ( len - head ) % page_size;
+      int err = target.check_storage( out, out + head, true );
+      if( !err ){
+        err = target.check_storage( out + len - tail, out + len, true );
+      }
+      if( err ){
+        return err;
+      }
+      copy_bytes( target, in, out, head );
+      size_t done = head;
+      if( aligned && len - done >= page_size ){
+        // the ranges do not overlap, so the pages of the source are
+        // not touched when those of the target are replaced
+        const off_t from = ( in + done ) / page_size;
+        const off_t to = ( out + done ) / page_size;
+        const off_t count = ( len - done ) / page_size;
+        target._pages.erase( target._pages.lower_bound( to ), target._pages.lower_bound( to + count ) );
+        pages_t::const_iterator i = _pages.lower_bound( from );
+        for( ; i != _pages.end() && i->first < from + count; ++i ){
+          target._pages.insert( std::make_pair( to + ( i->first - from ), i->second ) );
+        }
+        done += count * page_size;
+      }
+      copy_bytes( target, in + done, out + done, len - done );
+      target._size = std::max< off_t >( target._size, out + len );
+      return len;
+    }
+
+    void copy_bytes( page_store& target, off_t in, off_t out, size_t len ){
+      char buf[ page_size ];
+      size_t done = 0;
+      while( done < len ){
+        const size_t n = std::min< size_t >( page_size, len - done );
+        read_at( buf, n, in + done );
+        target.write_at( buf, n, out + done );
+        done += n;
+      }
+    }
+
+    std::mutex _mutex;
+    /// the allocated pages by their number.
+    pages_t _pages;
+    off_t _size;
+  };
+
+}
+
+#endif
+
+
+
@@ -0,0 +1,209 @@
+
+#ifndef __FUSEKIT__PERFECT_HASH_INDEX_H
+#define __FUSEKIT__PERFECT_HASH_INDEX_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <new>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fusekit/entry.h>
+#include <fusekit/child_index.h>
+
+namespace fusekit{
+
+  /// immutable child index built from a fixed set of children
+  /// (see directory_node::freeze).
+  ///
+  /// the names are placed into a table of cache line sized slots by a
+  /// hash and displace scheme: the hash of a name selects a bucket, the
+  /// displacement of the bucket selects the slot. as no two names share
+  /// a slot, a lookup reads one displacement and one slot. names which
+  /// fit into a slot are stored inline, so that the lookup does not
+  /// follow any pointer but the one to the child.
+  struct perfect_hash_index {
+
+    explicit perfect_hash_index( const children_t& children )
+      : _slots( 0 )
+      , _slot_count( 0 )
+      , _size( children.size() ){
+      if( _size ){
+        build( children );
+      }
+    }
+
+    ~perfect_hash_index(){
+      ::free( _slots );
+    }
+
+    entry* find( const char* name ) const {
+      if( !_size ){
+        return 0;
+      }
+      const size_t length = ::strlen( name );
+      const uint64_t h = hash( name, length );
+      const slot& s = _slots[ position( h, _displacements[ h % _displacements.size() ] ) ];
+      if( s.length != length || s.check != static_cast< uint32_t >( h >> 32 ) ){
+        return 0;
+      }
+      return ::memcmp( s.stored(), name, length ) == 0 ? s.child : 0;
+    }
+
+    size_t size() const {
+      return _size;
+    }
+
+    template< class Visitor >
+    void visit( Visitor& visitor ) const {
+      for( size_t i = 0; i < _slot_count; ++i ){
+        const slot& s = _slots[i];
+        if( s.child ){
+          visitor( std::string( s.stored(), s.length ), s.child );
+        }
+      }
+    }
+
+  private:
+    perfect_hash_index( const perfect_hash_index& );
+    perfect_hash_index& operator=( const perfect_hash_index& );
+
+    static const size_t cache_line = 64;
+    static const size_t inline_name = cache_line - sizeof(entry*) - 2 * sizeof(uint32_t);
+
+    struct slot {
+      entry* child;
+      uint32_t length;
+      uint32_t check;
+      union {
+        char name[ inline_name ];
+        const char* long_name;
+      };
+
+      const char* stored() const {
+        return length <= inline_name ? name : long_name;
+      }
+    };
+
+    struct key {
+      const std::string* name;
+      entry* child;
+      uint64_t h;
+    };
+
+    /// keys of a bucket, the largest buckets are placed first.
+    struct bucket {
+      size_t index;
+      std::vector< const key* > keys;
+      bool operator<( const bucket& other ) const {
+        return keys.size() > other.keys.size();
+      }
+    };
+
+    static uint64_t mix( uint64_t h ){
+      h ^= h >> 33;
+      h *= 0xff51afd7ed558ccdULL;
+      h ^= h >> 33;
+      h *= 0xc4ceb9fe1a85ec53ULL;
+      h ^= h >> 33;
+      return h;
+    }
+
+    static uint64_t hash( const char* name, size_t length ){
+      uint64_t h = 0xcbf29ce484222325ULL;
+      for( size_t i = 0; i < length; ++i ){
+        h ^= static_cast< unsigned char >( name[i] );
+        h *= 0x100000001b3ULL;
+      }
+      return mix( h );
+    }
+
+    size_t position( uint64_t h, uint32_t displacement ) const {
+      return mix( h ^ ( displacement * 0x9e3779b97f4a7c15ULL ) ) % _slot_count;
+    }
+
+    void build( const children_t& children ){
+      std::vector< key > keys( _size );
+      size_t long_names = 0;
+      for( size_t i = 0; i < _size; ++i ){
+        keys[i].name = &children[i].first;
+        keys[i].child = children[i].second;
+        keys[i].h = hash( keys[i].name->data(), keys[i].name->size() );
+        if( keys[i].name->size() > inline_name ){
+          long_names += keys[i].name->size();
+        }
+      }
+
+      // about four names per bucket and a load factor of 0.9
+      std::vector< bucket > buckets( _size / 4 + 1 );
+      _displacements.assign( buckets.size(), 0 );
+      for( size_t i = 0; i < buckets.size(); ++i ){
+        buckets[i].index = i;
+      }
+      for( size_t i = 0; i < _size; ++i ){
+        buckets[ keys[i].h % buckets.size() ].keys.push_back( &keys[i] );
+      }
+      std::stable_sort( buckets.begin(), buckets.end() );
+
+      _slot_count = _size + _size / 9 + 1;
+      void* memory = 0;
+      if( ::posix_memalign( &memory, cache_line, _slot_count * sizeof(slot) ) ){
+        throw std::bad_alloc();
+      }
+      _slots = static_cast< slot* >( memory );
+      ::memset( _slots, 0, _slot_count * sizeof(slot) );
+      _long_names.reserve( long_names );
+
+      std::vector< size_t > taken;
+      for( size_t b = 0; b < buckets.size() && !buckets[b].keys.empty(); ++b ){
+        const std::vector< const key* >& bucket_keys = buckets[b].keys;
+        uint32_t d = 0;
+        for( ;; ++d ){
+          taken.clear();
+          size_t k = 0;
+          for( ; k < bucket_keys.size(); ++k ){
+            const size_t p = position( bucket_keys[k]->h, d );
+            if( _slots[p].child || std::find( taken.begin(), taken.end(), p ) != taken.end() ){
+              break;
+            }
+            taken.push_back( p );
+          }
+          if( k == bucket_keys.size() ){
+            break;
+          }
+        }
+        _displacements[ buckets[b].index ] = d;
+        for( size_t k = 0; k < bucket_keys.size(); ++k ){
+          place( _slots[ taken[k] ], *bucket_keys[k] );
+        }
+      }
+    }
+
+    void place( slot& s, const key& k ){
+      s.child = k.child;
+      s.length = k.name->size();
+      s.check = static_cast< uint32_t >( k.h >> 32 );
+      if( s.length <= inline_name ){
+        ::memcpy( s.name, k.name->data(), s.length );
+      }
+      else{
+        // storage has been reserved, so earlier pointers stay valid
+        s.long_name = _long_names.data() + _long_names.size();
+        _long_names.insert( _long_names.end(), k.name->begin(), k.name->end() );
+      }
+    }
+
+    slot* _slots;
+    size_t _slot_count;
+    size_t _size;
+    std::vector< uint32_t > _displacements;
+    std::vector< char > _long_names;
+  };
+
+}
+
+#endif
+
+
+
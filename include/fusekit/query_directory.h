@@ -0,0 +1,258 @@
+
+#ifndef __FUSEKIT__QUERY_DIRECTORY_H
+#define __FUSEKIT__QUERY_DIRECTORY_H
+
+#include <string.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fusekit/entry.h>
+#include <fusekit/child_index.h>
+#include <fusekit/virtual_node.h>
+#include <fusekit/basic_directory.h>
+
+namespace fusekit{
+
+  /// true if name contains a special character of fnmatch(3).
+  inline
+  bool is_pattern( const char* name ){
+    return ::strpbrk( name, "*?[\\" ) != 0;
+  }
+
+  /// the directories of a query_directory.
+  struct query_cache
+    : public virtual_cache {
+
+    /// the query directory for the pattern in the directory reached by
+    /// following dir from root. an empty pattern returns a view of the
+    /// directory itself.
+    inline entry* get( entry& root, const std::vector< std::string >& dir, const std::string& pattern );
+  };
+
+  /// node policy of the directories below /.query/glob.
+  ///
+  /// a view mirrors a directory of the tree: child directories are views
+  /// again, other children are the entries of the tree themselves. a
+  /// name with pattern characters turns into a result directory, which
+  /// contains the children of the viewed directory matching the pattern.
+  /// /.query/glob/data/2026-10-* therefore lists the matches in /data.
+  /// the results are the entries of the tree, so they can be read and
+  /// written through the query path.
+  ///
+  /// matching runs in the daemon: only the children starting with the
+  /// literal prefix of the pattern are scanned (see entry::scan), which
+  /// is a range of the index for directories using a radix_index.
+  /// like in the shell, a leading dot has to be matched explicitly.
+  template<
+    class Derived
+    >
+  struct query_node
+    : public virtual_node {
+
+    query_node()
+      : _root( 0 )
+      , _cache( 0 ){
+    }
+
+    void bind( entry& root, const std::vector< std::string >& dir, const std::string& pattern, query_cache& cache ){
+      _root = &root;
+      _dir = dir;
+      _pattern = pattern;
+      _cache = &cache;
+    }
+
+    entry* find( const char* name ){
+      if( !_pattern.empty() ){
+        if( !matches( name ) ){
+          return 0;
+        }
+        entry* t = target();
+        return t ? t->child( name ) : 0;
+      }
+      if( is_pattern( name ) ){
+        return _cache->get( *_root, _dir, name );
+      }
+      entry* t = target();
+      entry* c = t ? t->child( name ) : 0;
+      if( !c || !is_directory( *c ) ){
+        return c;
+      }
+      std::vector< std::string > dir( _dir );
+      dir.push_back( name );
+      return _cache->get( *_root, dir, "" );
+    }
+
+    int readdir( void* buf, fill_dir_t filler, off_t offset, fuse_file_info& ){
+      name_list names;
+      const int err = scan( "", names );
+      if( err ){
+        return err;
+      }
+      filler( buf, ".", NULL, offset );
+      filler( buf, "..", NULL, offset );
+      for( size_t i = 0; i < names.names.size(); ++i ){
+        filler( buf, names.names[i].c_str(), NULL, offset );
+      }
+      return 0;
+    }
+
+    int scan( const std::string& prefix, child_visitor& visitor ){
+      entry* t = target();
+      if( !t ){
+        return -ENOENT;
+      }
+      if( _pattern.empty() ){
+        return t->scan( prefix, visitor );
+      }
+      const std::string literal = _pattern.substr( 0, _pattern.find_first_of( "*?[\\" ) );
+      const size_t common = std::min( literal.size(), prefix.size() );
+      if( literal.compare( 0, common, prefix, 0, common ) != 0 ){
+        return 0;
+      }
+      pattern_filter filter( *this, visitor );
+      return t->scan( literal.size() > prefix.size() ? literal : prefix, filter );
+    }
+
+  private:
+    struct name_list : public child_visitor {
+      void operator()( const std::string& name, entry* ){
+        names.push_back( name );
+      }
+      std::vector< std::string > names;
+    };
+
+    struct pattern_filter : public child_visitor {
+      pattern_filter( query_node& node, child_visitor& next )
+        : _node( node )
+        , _next( next ){
+      }
+      void operator()( const std::string& name, entry* e ){
+        if( _node.matches( name.c_str() ) ){
+          _next( name, e );
+        }
+      }
+    private:
+      query_node& _node;
+      child_visitor& _next;
+    };
+
+    bool matches( const char* name ) const {
+      return ::fnmatch( _pattern.c_str(), name, FNM_PERIOD ) == 0;
+    }
+
+    /// the viewed directory, looked up from the root for every
+    /// operation, so the query never refers to removed entries.
+    entry* target(){
+      entry* e = _root;
+      for( size_t i = 0; e && i < _dir.size(); ++i ){
+        e = e->child( _dir[i].c_str() );
+      }
+      return e;
+    }
+
+    static bool is_directory( entry& e ){
+      struct stat st;
+      ::memset( &st, 0, sizeof(st) );
+      e.stat( st );
+      return S_ISDIR( st.st_mode );
+    }
+
+    entry* _root;
+    std::vector< std::string > _dir;
+    std::string _pattern;
+    query_cache* _cache;
+  };
+
+  typedef basic_directory< query_node > query_entry;
+
+  /// creates the query_entry for a query_cache.
+  struct make_query_entry {
+    entry* operator()(){
+      query_entry* e = new query_entry;
+      e->bind( root, dir, pattern, cache );
+      return e;
+    }
+    entry& root;
+    const std::vector< std::string >& dir;
+    const std::string& pattern;
+    query_cache& cache;
+  };
+
+  inline
+  entry* query_cache::get( entry& root, const std::vector< std::string >& dir, const std::string& pattern ){
+    std::string key;
+    for( size_t i = 0; i < dir.size(); ++i ){
+      key += dir[i];
+      key += '/';
+    }
+    key += '\0';
+    key += pattern;
+    make_query_entry create = { root, dir, pattern, *this };
+    return virtual_cache::get( key, create );
+  }
+
+  /// node policy of the query root, e.g. /.query, with the query
+  /// types as children. glob is the only one so far.
+  template<
+    class Derived
+    >
+  struct query_directory_node
+    : public virtual_node {
+
+    query_directory_node()
+      : _root( 0 ){
+    }
+
+    /// the tree the queries run against.
+    void bind( entry& root ){
+      _root = &root;
+    }
+
+    entry* find( const char* name ){
+      if( _root && ::strcmp( name, "glob" ) == 0 ){
+        return _cache.get( *_root, std::vector< std::string >(), "" );
+      }
+      return 0;
+    }
+
+    int readdir( void* buf, fill_dir_t filler, off_t offset, fuse_file_info& ){
+      filler( buf, ".", NULL, offset );
+      filler( buf, "..", NULL, offset );
+      filler( buf, "glob", NULL, offset );
+      return 0;
+    }
+
+    int scan( const std::string& prefix, child_visitor& visitor ){
+      if( std::string( "glob" ).compare( 0, prefix.size(), prefix ) == 0 ){
+        entry* e = find( "glob" );
+        if( e ){
+          visitor( "glob", e );
+        }
+      }
+      return 0;
+    }
+
+  private:
+    entry* _root;
+    query_cache _cache;
+  };
+
+  typedef basic_directory< query_directory_node > query_directory;
+
+  /// a query directory for the tree below root, to be added to the tree:
+  /// root.add_directory( ".query", make_query_directory( root ) );
+  inline
+  query_directory* make_query_directory( entry& root ){
+    query_directory* q = new query_directory;
+    q->bind( root );
+    return q;
+  }
+
+}
+
+#endif
+
+
+
@@ -0,0 +1,297 @@
+
+#ifndef __FUSEKIT__RADIX_INDEX_H
+#define __FUSEKIT__RADIX_INDEX_H
+
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fusekit/entry.h>
+
+namespace fusekit{
+
+  /// child index of the factories as a compressed radix trie.
+  ///
+  /// names which share a prefix (like shard-000123-part-0042.dat) store
+  /// the prefix once: every node of the trie holds the part of the name
+  /// which is not shared with its siblings, chains of nodes without a
+  /// branch are merged into one. the children of a node are ordered by
+  /// their first byte, so visit enumerates the names in the order of
+  /// std::string, and visit_prefix and visit_range only descend into the
+  /// parts of the trie which can match.
+  ///
+  /// radix_index is copyable, so it can be wrapped by rcu_index.
+  struct radix_index {
+
+    template< class Lock >
+    struct read_lock {
+      typedef Lock type;
+    };
+
+    radix_index()
+      : _root( new node )
+      , _size( 0 ){
+    }
+
+    radix_index( const radix_index& other )
+      : _root( copy( other._root ) )
+      , _size( other._size ){
+    }
+
+    ~radix_index(){
+      destroy( _root );
+    }
+
+    entry* find( const char* name ) const {
+      const node* n = _root;
+      while( *name ){
+        n = n->child( *name );
+        if( !n || ::strncmp( n->label.c_str(), name, n->label.size() ) != 0 ){
+          return 0;
+        }
+        name += n->label.size();
+      }
+      return n->value;
+    }
+
+    /// adds (or replaces) the child name and returns the replaced
+    /// entry or 0.
+    entry* insert( const char* name, entry* child ){
+      node* n = _root;
+      while( *name ){
+        node* next = n->child( *name );
+        if( !next ){
+          node* leaf = new node;
+          leaf->label = name;
+          n->add( leaf );
+          n = leaf;
+          break;
+        }
+        const size_t common = shared( next->label, name );
+        if( common < next->label.size() ){
+          split( next, common );
+        }
+        n = next;
+        name += common;
+      }
+      entry* replaced = n->value;
+      n->value = child;
+      if( !replaced ){
+        ++_size;
+      }
+      return replaced;
+    }
+
+    /// removes the child name and returns its entry or 0.
+    entry* erase( const char* name ){
+      entry* erased = erase( _root, name );
+      if( erased ){
+        --_size;
+      }
+      return erased;
+    }
+
+    size_t size() const {
+      return _size;
+    }
+
+    /// calls visitor( name, entry ) for all children in ascending order.
+    template< class Visitor >
+    void visit( Visitor& visitor ) const {
+      std::string name;
+      walk( _root, name, visitor );
+    }
+
+    /// calls visitor( name, entry ) for the children whose names
+    /// start with prefix, in ascending order.
+    template< class Visitor >
+    void visit_prefix( const std::string& prefix, Visitor& visitor ) const {
+      const node* n = _root;
+      std::string name;
+      size_t matched = 0;
+      while( matched < prefix.size() ){
+        n = n->child( prefix[ matched ] );
+        if( !n ){
+          return;
+        }
+        const size_t length = std::min( n->label.size(), prefix.size() - matched );
+        if( n->label.compare( 0, length, prefix, matched, length ) != 0 ){
+          return;
+        }
+        name += n->label;
+        matched += length;
+      }
+      walk( n, name, visitor );
+    }
+
+    /// calls visitor( name, entry ) for the children with first <= name < last,
+    /// in ascending order. an empty last means no upper bound.
+    template< class Visitor >
+    void visit_range( const std::string& first, const std::string& last, Visitor& visitor ) const {
+      std::string name;
+      walk_range( _root, name, first, last, visitor );
+    }
+
+    static void retire( entry* e ){
+      if( e->drop() == 0 ){
+        delete e;
+      }
+    }
+
+  private:
+    radix_index& operator=( const radix_index& );
+
+    struct node {
+      node()
+        : value( 0 ){
+      }
+
+      /// the child whose label starts with c.
+      node* child( char c ) const {
+        std::vector< node* >::const_iterator i = lower_bound( c );
+        return i != children.end() && (*i)->label[0] == c ? *i : 0;
+      }
+
+      std::vector< node* >::const_iterator lower_bound( char c ) const {
+        return std::lower_bound( children.begin(), children.end(), c, &node::before );
+      }
+
+      void add( node* n ){
+        std::vector< node* >::iterator i = children.begin() + ( lower_bound( n->label[0] ) - children.begin() );
+        children.insert( i, n );
+      }
+
+      void remove( node* n ){
+        children.erase( std::find( children.begin(), children.end(), n ) );
+      }
+
+      static bool before( const node* n, char c ){
+        return static_cast< unsigned char >( n->label[0] ) < static_cast< unsigned char >( c );
+      }
+
+      std::string label;
+      entry* value;
+      std::vector< node* > children;
+    };
+
+    static size_t shared( const std::string& label, const char* name ){
+      size_t i = 0;
+      while( i < label.size() && name[i] == label[i] ){
+        ++i;
+      }
+      return i;
+    }
+
+    /// splits the label of n after length characters: n keeps the
+    /// head, a new child takes over the tail, the value and the children.
+    static void split( node* n, size_t length ){
+      node* tail = new node;
+      tail->label = n->label.substr( length );
+      tail->value = n->value;
+      tail->children.swap( n->children );
+      n->label.erase( length );
+      n->value = 0;
+      n->children.push_back( tail );
+    }
+
+    /// merges n with its only child, if n has no value.
+    static void merge( node* n ){
+      if( n->value || n->children.size() != 1 ){
+        return;
+      }
+      node* only = n->children[0];
+      n->label += only->label;
+      n->value = only->value;
+      n->children.swap( only->children );
+      delete only;
+    }
+
+    /// removes name below n and cleans up the nodes on the way back,
+    /// n itself is merged by the caller (the root never is).
+    static entry* erase( node* n, const char* name ){
+      if( !*name ){
+        entry* erased = n->value;
+        n->value = 0;
+        return erased;
+      }
+      node* next = n->child( *name );
+      if( !next || ::strncmp( next->label.c_str(), name, next->label.size() ) != 0 ){
+        return 0;
+      }
+      entry* erased = erase( next, name + next->label.size() );
+      if( erased ){
+        if( !next->value && next->children.empty() ){
+          n->remove( next );
+          delete next;
+        }
+        else{
+          merge( next );
+        }
+      }
+      return erased;
+    }
+
+    template< class Visitor >
+    static void walk( const node* n, std::string& name, Visitor& visitor ){
+      if( n->value ){
+        visitor( name, n->value );
+      }
+      for( size_t i = 0; i < n->children.size(); ++i ){
+        const node* c = n->children[i];
+        name += c->label;
+        walk( c, name, visitor );
+        name.erase( name.size() - c->label.size() );
+      }
+    }
+
+    /// name is the common prefix of all names below n.
+    template< class Visitor >
+    static void walk_range( const node* n, std::string& name, const std::string& first, const std::string& last, Visitor& visitor ){
+      if( name.compare( 0, name.size(), first, 0, name.size() ) < 0 ){
+        // all names below are less than first
+        return;
+      }
+      if( n->value && name >= first && ( last.empty() || name < last ) ){
+        visitor( name, n->value );
+      }
+      for( size_t i = 0; i < n->children.size(); ++i ){
+        const node* c = n->children[i];
+        name += c->label;
+        if( !last.empty() && name >= last ){
+          // so are all names below and behind c
+          name.erase( name.size() - c->label.size() );
+          return;
+        }
+        walk_range( c, name, first, last, visitor );
+        name.erase( name.size() - c->label.size() );
+      }
+    }
+
+    static node* copy( const node* n ){
+      node* c = new node;
+      c->label = n->label;
+      c->value = n->value;
+      c->children.reserve( n->children.size() );
+      for( size_t i = 0; i < n->children.size(); ++i ){
+        c->children.push_back( copy( n->children[i] ) );
+      }
+      return c;
+    }
+
+    static void destroy( node* n ){
+      for( size_t i = 0; i < n->children.size(); ++i ){
+        destroy( n->children[i] );
+      }
+      delete n;
+    }
+
+    node* _root;
+    size_t _size;
+  };
+
+}
+
+#endif
+
+
+
@@ -0,0 +1,284 @@
+
+#ifndef __FUSEKIT__RCU_DOMAIN_H
+#define __FUSEKIT__RCU_DOMAIN_H
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#ifdef __linux__
+#include <linux/membarrier.h>
+#endif
+
+namespace fusekit{
+
+  /// epoch based reclamation for read-copy-update structures (see rcu_index).
+  ///
+  /// readers enclose their accesses in a read_section. entering and
+  /// leaving a section only stores the epoch of the reader into its
+  /// thread local record: there are no locks and no atomic read-modify-write
+  /// operations on the read side. writers publish new versions and retire
+  /// the old ones, which are deleted as soon as no reader which might
+  /// still see them is inside a section.
+  ///
+  /// the store of the reader has to be visible to the writer before the
+  /// reader loads a published pointer. on linux this is achieved by
+  /// membarrier(2), which makes the writer pay for the barrier. if
+  /// membarrier is not available, readers fall back to a full fence.
+  ///
+  /// retired versions are collected when they are retired, on reclaim()
+  /// and when the last reader which might still see the oldest of them
+  /// leaves its section, so that they do not pile up between writes.
+  struct rcu_domain {
+  private:
+    struct reader;
+
+  public:
+    static rcu_domain& instance(){
+      static rcu_domain d;
+      return d;
+    }
+
+    /// read-side critical section. sections may be nested.
+    ///
+    /// a thread which is not inside a section does not hold back the
+    /// reclamation of retired versions.
+    struct read_section {
+      read_section()
+        : _reader( rcu_domain::instance().enter() ){
+      }
+
+      ~read_section(){
+        rcu_domain::instance().leave( _reader );
+      }
+
+    private:
+      read_section( const read_section& );
+      read_section& operator=( const read_section& );
+
+      reader& _reader;
+    };
+
+    /// hands a no longer published object over to the domain, which
+    /// deletes it once no reader can access it anymore.
+    template< class T >
+    void retire( T* p ){
+      if( p ){
+        retire( p, &rcu_domain::destroy< T > );
+      }
+    }
+
+    void retire( void* p, void (*destroy)( void* ) ){
+      std::lock_guard< std::mutex > guard( _mutex );
+      // readers entering with the new epoch will see the new version
+      const unsigned long tag = _epoch.load( std::memory_order_relaxed );
+      _epoch.store( tag + 1, std::memory_order_release );
+      retired r = { tag, p, destroy };
+      _retired.push_back( r );
+      collect();
+      update_oldest();
+    }
+
+    /// deletes all retired objects which are not visible to readers anymore.
+    void reclaim(){
+      std::lock_guard< std::mutex > guard( _mutex );
+      collect();
+      update_oldest();
+    }
+
+  private:
+    struct reader {
+      reader()
+        : epoch( offline )
+        , nesting( 0 )
+        , next( 0 ){
+      }
+      std::atomic< unsigned long > epoch;
+      unsigned int nesting;
+      reader* next;
+    };
+
+    struct retired {
+      unsigned long tag;
+      void* p;
+      void (*destroy)( void* );
+    };
+
+    /// unregisters the reader of a thread when the thread exits.
+    struct registration {
+      registration()
+        : r( 0 ){
+      }
+      ~registration(){
+        if( r ){
+          rcu_domain::instance().unregister( r );
+        }
+      }
+      reader* r;
+    };
+
+    static const unsigned long offline = 0;
+    static const unsigned long none = ~0UL;
+
+    rcu_domain()
+      : _epoch( 1 )
+      , _oldest( none )
+      , _readers( 0 )
+      , _asymmetric( false ){
+#ifdef __NR_membarrier
+      _asymmetric = ::syscall( __NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0 ) == 0;
+#endif
+    }
+
+    ~rcu_domain(){
+      std::vector< retired >::iterator i = _retired.begin();
+      while( i != _retired.end() ){
+        i->destroy( i->p );
+        ++i;
+      }
+      while( _readers ){
+        reader* r = _readers;
+        _readers = r->next;
+        delete r;
+      }
+    }
+
+    template< class T >
+    static void destroy( void* p ){
+      delete static_cast< T* >( p );
+    }
+
+    reader& enter(){
+      static thread_local registration local;
+      if( !local.r ){
+        local.r = register_reader();
+      }
+      reader& r = *local.r;
+      if( r.nesting++ == 0 ){
+        r.epoch.store( _epoch.load( std::memory_order_acquire ), std::memory_order_relaxed );
+        if( _asymmetric ){
+          std::atomic_signal_fence( std::memory_order_seq_cst );
+        }
+        else{
+          std::atomic_thread_fence( std::memory_order_seq_cst );
+        }
+      }
+      return r;
+    }
+
+    void leave( reader& r ){
+      if( --r.nesting == 0 ){
+        const unsigned long e = r.epoch.load( std::memory_order_relaxed );
+        r.epoch.store( offline, std::memory_order_release );
+        // the reader may have held back the oldest retired version. a
+        // writer holding the mutex collects anyway, so do not wait for it.
+        // with nothing retired the shared mutex is not touched at all.
+        const unsigned long oldest = _oldest.load( std::memory_order_relaxed );
+        if( oldest != none && e <= oldest && _mutex.try_lock() ){
+          collect();
+          update_oldest();
+          _mutex.unlock();
+        }
+      }
+    }
+
+    reader* register_reader(){
+      std::lock_guard< std::mutex > guard( _mutex );
+      reader* r = new reader;
+      r->next = _readers;
+      _readers = r;
+      return r;
+    }
+
+    void unregister( reader* r ){
+      std::lock_guard< std::mutex > guard( _mutex );
+      reader** p = &_readers;
+      while( *p != r ){
+        p = &(*p)->next;
+      }
+      *p = r->next;
+      delete r;
+      collect();
+      update_oldest();
+    }
+
+    /// requires _mutex to be held.
+    void collect(){
+      if( _retired.empty() ){
+        return;
+      }
+      // either the epoch store of a reader which is entering is visible
+      // now, or the reader will see all versions published up to here.
+#ifdef __NR_membarrier
+      if( _asymmetric ){
+        ::syscall( __NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0 );
+      }
+      else
+#endif
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+
+      unsigned long oldest = _epoch.load( std::memory_order_relaxed );
+      for( reader* r = _readers; r; r = r->next ){
+        const unsigned long e = r->epoch.load( std::memory_order_acquire );
+        if( e != offline && e < oldest ){
+          oldest = e;
+        }
+      }
+      // a reader which entered with epoch e may see versions retired
+      // with tag >= e only.
+      std::vector< retired >::iterator keep = _retired.begin();
+      std::vector< retired >::iterator i = _retired.begin();
+      while( i != _retired.end() ){
+        if( i->tag < oldest ){
+          i->destroy( i->p );
+        }
+        else{
+          *keep++ = *i;
+        }
+        ++i;
+      }
+      _retired.erase( keep, _retired.end() );
+    }
+
+    /// requires _mutex to be held. tags are retired in increasing order.
+    void update_oldest(){
+      _oldest.store( _retired.empty() ? none : _retired.front().tag, std::memory_order_relaxed );
+    }
+
+    std::atomic< unsigned long > _epoch;
+    std::atomic< unsigned long > _oldest;
+    std::mutex _mutex;
+    reader* _readers;
+    std::vector< retired > _retired;
+    bool _asymmetric;
+  };
+
+  /// locking policy which turns every operation of the daemon
+  /// into an rcu read-side critical section.
+  ///
+  /// use it as LockingPolicy of the daemon when the directories of the
+  /// tree use rcu_index: lookups of the application threads then run
+  /// concurrently without any lock. it does not serialize writers, so
+  /// the daemon still serializes the operations of a multithreaded loop.
+  struct rcu_lock {
+    /// objects dropped from the tree are deleted after the readers
+    /// which may still use them (see reclaim).
+    static void retire( void* p, void (*destroy)( void* ) ){
+      rcu_domain::instance().retire( p, destroy );
+    }
+
+    struct lock{
+      lock( rcu_lock& ){
+      }
+    private:
+      rcu_domain::read_section _section;
+    };
+  };
+
+}
+
+#endif
+
+
+
@@ -0,0 +1,119 @@
+
+#ifndef __FUSEKIT__RCU_INDEX_H
+#define __FUSEKIT__RCU_INDEX_H
+
+#include <atomic>
+#include <mutex>
+#include <fusekit/entry.h>
+#include <fusekit/child_index.h>
+#include <fusekit/hashed_index.h>
+#include <fusekit/rcu_domain.h>
+
+namespace fusekit{
+
+  /// guard type of lookups which do not need any lock.
+  struct no_read_lock {
+    template< class Lockable >
+    no_read_lock( Lockable& ){
+    }
+  };
+
+  /// read-copy-update child index for the factories.
+  ///
+  /// readers (find, size, visit) load the currently published version of
+  /// the wrapped Index and never take a lock. writers copy the current
+  /// version, change the copy and publish it; the old version and removed
+  /// entries are retired to the rcu_domain. writers are serialized by the
+  /// index itself, so the factory lock is only needed to make check and
+  /// change sequences (like create) atomic.
+  ///
+  /// as every change copies the whole index, rcu_index is meant for
+  /// directories which are looked up far more often than they are changed.
+  /// lookups must happen inside a rcu_domain::read_section, e.g. by running
+  /// the daemon with rcu_lock as its LockingPolicy. reading without a
+  /// section is only safe while there are no concurrent writers.
+  template< class Index = hashed_index >
+  struct rcu_index {
+
+    template< class Lock >
+    struct read_lock {
+      typedef no_read_lock type;
+    };
+
+    rcu_index()
+      : _current( new Index ){
+    }
+
+    ~rcu_index(){
+      delete _current.load( std::memory_order_relaxed );
+    }
+
+    entry* find( const char* name ) const {
+      return current().find( name );
+    }
+
+    entry* insert( const char* name, entry* child ){
+      std::lock_guard< std::mutex > guard( _writer );
+      Index* next = new Index( current() );
+      entry* replaced = next->insert( name, child );
+      publish( next );
+      return replaced;
+    }
+
+    entry* erase( const char* name ){
+      std::lock_guard< std::mutex > guard( _writer );
+      if( !current().find( name ) ){
+        return 0;
+      }
+      Index* next = new Index( current() );
+      entry* erased = next->erase( name );
+      publish( next );
+      return erased;
+    }
+
+    size_t size() const {
+      return current().size();
+    }
+
+    template< class Visitor >
+    void visit( Visitor& visitor ) const {
+      current().visit( visitor );
+    }
+
+    template< class Visitor >
+    void visit_prefix( const std::string& prefix, Visitor& visitor ) const {
+      fusekit::visit_prefix( current(), prefix, visitor );
+    }
+
+    /// readers may still use the entry, so it is deleted after
+    /// all of them have left their read sections.
+    static void retire( entry* e ){
+      if( e->drop() == 0 ){
+        rcu_domain::instance().retire( e );
+      }
+    }
+
+  private:
+    rcu_index( const rcu_index& );
+    rcu_index& operator=( const rcu_index& );
+
+    const Index& current() const {
+      return *_current.load( std::memory_order_acquire );
+    }
+
+    void publish( Index* next ){
+      Index* previous = _current.load( std::memory_order_relaxed );
+      _current.store( next, std::memory_order_release );
+      rcu_domain::instance().retire( previous );
+    }
+
+    std::atomic< Index* > _current;
+    std::mutex _writer;
+  };
+
+}
+
+#endif
+
+
+
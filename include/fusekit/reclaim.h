@@ -0,0 +1,73 @@
+
+#ifndef __FUSEKIT__RECLAIM_H
+#define __FUSEKIT__RECLAIM_H
+
+#include <fusekit/rcu_domain.h>
+
+namespace fusekit{
+
+  /// deletes objects which have been dropped from the tree, but may
+  /// still be used by operations running at the same time, like the
+  /// nested directories of an overlay or a removed snapshot.
+  ///
+  /// how long they have to be kept depends on the LockingPolicy of the
+  /// daemon, which makes its retire function current while it runs an
+  /// operation (see daemon::scope). with rcu_lock readers run
+  /// concurrently, so the objects are handed to the rcu_domain. the
+  /// other policies run the operations one at a time (see daemon::lock),
+  /// so the objects are deleted at once. outside of a scope they are
+  /// handed to the rcu_domain as well.
+  struct reclaim {
+    typedef void (*retire_function)( void* p, void (*destroy)( void* ) );
+
+    template< class T >
+    static void retire( T* p ){
+      if( p ){
+        current()( p, &reclaim::destroy< T > );
+      }
+    }
+
+    /// deletes p at once.
+    static void immediately( void* p, void (*destroy)( void* ) ){
+      destroy( p );
+    }
+
+    /// deletes p once no reader of the rcu_domain can access it.
+    static void deferred( void* p, void (*destroy)( void* ) ){
+      rcu_domain::instance().retire( p, destroy );
+    }
+
+    /// makes retire the current function of this thread.
+    struct scope {
+      explicit scope( retire_function retire )
+        : _previous( current() ){
+        current() = retire;
+      }
+
+      ~scope(){
+        current() = _previous;
+      }
+
+    private:
+      scope( const scope& );
+      scope& operator=( const scope& );
+      retire_function _previous;
+    };
+
+  private:
+    template< class T >
+    static void destroy( void* p ){
+      delete static_cast< T* >( p );
+    }
+
+    static retire_function& current(){
+      static thread_local retire_function f = &reclaim::deferred;
+      return f;
+    }
+  };
+
+}
+
+#endif
+
+
@@ -0,0 +1,289 @@
+
+#ifndef __FUSEKIT__SHARED_FILE_H
+#define __FUSEKIT__SHARED_FILE_H
+
+#include <string.h>
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <fusekit/entry.h>
+#include <fusekit/basic_file.h>
+#include <fusekit/change_log.h>
+#include <fusekit/default_xattr.h>
+#include <fusekit/shared_region.h>
+#include <fusekit/time_fields.h>
+#include <fusekit/usage.h>
+
+namespace fusekit{
+
+  /// buffer policy keeping the content of a file in a shared_region, so
+  /// clients on the same host read it without a request to the daemon
+  /// (see shared_reader). the mount stays the source of truth: writes
+  /// through the mount and publish change the region, and every change
+  /// is a new version for the clients.
+  ///
+  /// the region grows by replacing it with a larger one, which the
+  /// clients find by repeating the handshake. without shared memory
+  /// (no /dev/shm) changes fail with the error of shm_open. the bytes
+  /// of the content are counted in the usage, so a growing write fails
+  /// with -ENOSPC beyond the byte limit, like one to a memory file.
+  template<
+    class Derived
+    >
+  struct shared_buffer {
+    shared_buffer()
+      : _mode( 0400 ){
+    }
+
+    ~shared_buffer(){
+      usage::instance().add_bytes( -static_cast< long long >( _region.size() ) );
+    }
+
+    /// the mode of the regions created from now on, 0400 by default:
+    /// only processes of the user of the daemon may map them.
+    void share( mode_t mode ){
+      std::lock_guard< std::mutex > guard( _mutex );
+      _mode = mode;
+    }
+
+    /// replaces the content, one new version for the clients. -errno on
+    /// failure.
+    ///
+    /// the region is guarded by the buffer, but publish also updates the
+    /// times and the subtree totals of the entry and records the change,
+    /// like a write through the mount. an application thread therefore
+    /// publishes under the lock of a daemon whose LockingPolicy
+    /// serializes it with the operations (e.g. mutex_lock), which also
+    /// records the change in the change_log of that daemon.
+    int publish( const char* data, size_t size ){
+      size_t before;
+      {
+        std::lock_guard< std::mutex > guard( _mutex );
+        before = _region.size();
+        const int err = grow( before, size );
+        if( err ){
+          return err;
+        }
+        _region.begin();
+        ::memcpy( _region.data(), data, size );
+        _region.end( size );
+      }
+      change_log::instance().record( change_write );
+      changed( before, size );
+      return 0;
+    }
+
+    int publish( const std::string& content ){
+      return publish( content.data(), content.size() );
+    }
+
+    /// the name of the region for the handshake, created on demand.
+    /// empty if shared memory is not available.
+    std::string shared_name(){
+      std::lock_guard< std::mutex > guard( _mutex );
+      reserve( 0 );
+      return _region.name();
+    }
+
+    int open( fuse_file_info& ){
+      return 0;
+    }
+
+    int close( fuse_file_info& ){
+      return 0;
+    }
+
+    off_t size(){
+      std::lock_guard< std::mutex > guard( _mutex );
+      return _region.size();
+    }
+
+    blkcnt_t blocks(){
+      std::lock_guard< std::mutex > guard( _mutex );
+      return blocks( _region.size() );
+    }
+
+    int read( char* buf, size_t size, off_t offset, fuse_file_info& ){
+      std::lock_guard< std::mutex > guard( _mutex );
+      if( offset < 0 || static_cast< size_t >( offset ) >= _region.size() ){
+        return 0;
+      }
+      const size_t count = std::min( size, _region.size() - offset );
+      ::memcpy( buf, _region.data() + offset, count );
+      return count;
+    }
+
+    int write( const char* buf, size_t size, off_t offset, fuse_file_info& ){
+      if( offset < 0 ){
+        return -EINVAL;
+      }
+      size_t current;
+      size_t end = offset + size;
+      {
+        std::lock_guard< std::mutex > guard( _mutex );
+        current = _region.size();
+        const int err = grow( current, end );
+        if( err ){
+          return err;
+        }
+        end = std::max( current, end );
+        _region.begin();
+        if( static_cast< size_t >( offset ) > current ){
+          ::memset( _region.data() + current, 0, offset - current );
+        }
+        ::memcpy( _region.data() + offset, buf, size );
+        _region.end( end );
+      }
+      change_log::instance().record( change_write );
+      changed( current, end );
+      return size;
+    }
+
+    int truncate( off_t size ){
+      if( size < 0 ){
+        return -EINVAL;
+      }
+      size_t current;
+      {
+        std::lock_guard< std::mutex > guard( _mutex );
+        current = _region.size();
+        const int err = grow( current, size );
+        if( err ){
+          return err;
+        }
+        _region.begin();
+        if( static_cast< size_t >( size ) > current ){
+          ::memset( _region.data() + current, 0, size - current );
+        }
+        _region.end( size );
+      }
+      change_log::instance().record( change_truncate );
+      changed( current, size );
+      return 0;
+    }
+
+    int flush( fuse_file_info& ){
+      return 0;
+    }
+
+    int fallocate( int, off_t, off_t, fuse_file_info& ){
+      return -EOPNOTSUPP;
+    }
+
+    off_t lseek( off_t offset, int whence, fuse_file_info& ){
+      const off_t end = size();
+      if( offset < 0 || offset >= end ){
+        return -ENXIO;
+      }
+      return whence == SEEK_DATA ? offset : end;
+    }
+
+    int readlink( char*, size_t ){
+      return -EINVAL;
+    }
+
+    ssize_t copy_file_range( fuse_file_info&, off_t, entry&, fuse_file_info&, off_t, size_t, int ){
+      return -EOPNOTSUPP;
+    }
+
+  private:
+    /// checks the byte limit if the content grows from current to size
+    /// bytes and makes room for them. called with the mutex held.
+    int grow( size_t current, size_t size ){
+      if( size > current ){
+        const int err = usage::instance().check_bytes( size - current );
+        if( err ){
+          return err;
+        }
+      }
+      return reserve( size );
+    }
+
+    /// makes room for size bytes: a region of twice the size replaces
+    /// the current one if it is too small. called with the mutex held.
+    int reserve( size_t size ){
+      if( _region.valid() && size <= _region.capacity() ){
+        return 0;
+      }
+      shared_region larger;
+      const int err = larger.create( std::max< size_t >( 2 * size, 4096 - shared_header::data ), _mode, _region.sequence() + 2 );
+      if( err ){
+        return err;
+      }
+      if( _region.valid() ){
+        larger.begin();
+        ::memcpy( larger.data(), _region.data(), _region.size() );
+        larger.end( _region.size() );
+      }
+      _region.retire();
+      _region.swap( larger );
+      return 0;
+    }
+
+    static blkcnt_t blocks( size_t size ){
+      return ( size + 511 ) / 512;
+    }
+
+    /// the size changed from before to after.
+    void changed( size_t before, size_t after ){
+      usage::instance().add_bytes( static_cast< long long >( after ) - static_cast< long long >( before ) );
+      static_cast< Derived* >(this)->update( fusekit::modification_time | fusekit::change_time );
+      static_cast< Derived* >(this)->resized( off_t( after ) - off_t( before ), blocks( after ) - blocks( before ) );
+    }
+
+    std::mutex _mutex;
+    shared_region _region;
+    mode_t _mode;
+  };
+
+  /// default_xattr answering shared_xattr with the name of the region of
+  /// the shared_buffer.
+  template<
+    class Derived
+    >
+  struct shared_xattr_policy
+    : public default_xattr< Derived > {
+
+    int getxattr( const char *name, char *value, size_t size ){
+      if( ::strcmp( name, shared_xattr ) != 0 ){
+        return default_xattr< Derived >::getxattr( name, value, size );
+      }
+      const std::string region = static_cast< Derived* >(this)->shared_name();
+      if( region.empty() ){
+        return -ENODATA;
+      }
+      if( size != 0 ){
+        if( region.size() > size ){
+          return -ERANGE;
+        }
+        ::memcpy( value, region.data(), region.size() );
+      }
+      return region.size();
+    }
+  };
+
+  /// a regular, writable file with its content in shared memory:
+  ///
+  ///   shared_file<>::type* report = make_shared_file();
+  ///   root.add_file( "report", report );
+  ///   daemon< root_type, mutex_lock >::lock guard( d );
+  ///   report->publish( generate() );
+  template<
+    template <class> class TimePolicy = default_time,
+    template <class> class PermissionPolicy = default_file_permissions
+    >
+  struct shared_file{
+    typedef basic_file< shared_buffer, TimePolicy, PermissionPolicy, shared_xattr_policy > type;
+  };
+
+  inline
+  shared_file<>::type* make_shared_file(){
+    return new shared_file<>::type;
+  }
+
+}
+
+#endif
+
+
+
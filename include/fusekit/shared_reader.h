@@ -0,0 +1,166 @@
+
+#ifndef __FUSEKIT__SHARED_READER_H
+#define __FUSEKIT__SHARED_READER_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <string>
+#include <fusekit/shared_region.h>
+
+namespace fusekit{
+
+  /// the client side of a shared_file, for processes on the same host
+  /// which read it often: after the handshake (getxattr of shared_xattr
+  /// on the file in the mount) the region is mapped read only, and reads
+  /// copy the latest version without a request to the daemon.
+  ///
+  ///   fusekit::shared_reader r;
+  ///   if( r.open( "/mnt/report" ) == 0 ){
+  ///     uint64_t seen = 0;
+  ///     std::string content;
+  ///     for( ;; ){
+  ///       if( r.version() != seen ){
+  ///         r.read( content, &seen );
+  ///       }
+  ///     }
+  ///   }
+  ///
+  /// the reader needs no libfuse and is not thread safe, every thread
+  /// uses one of its own.
+  struct shared_reader {
+    shared_reader()
+      : _header( 0 )
+      , _length( 0 ){
+    }
+
+    ~shared_reader(){
+      close();
+    }
+
+    /// the handshake with the shared_file path. -errno on failure,
+    /// -ENODATA if the file is not shared.
+    int open( const char* path ){
+      close();
+      _path = path;
+      return attach();
+    }
+
+    void close(){
+      if( _header ){
+        ::munmap( const_cast< shared_header* >( _header ), _length );
+      }
+      _header = 0;
+      _length = 0;
+    }
+
+    /// the version of the content, which changes with every change. 0
+    /// without a region. cheap, to skip reads of unchanged content.
+    uint64_t version(){
+      if( !_header || __atomic_load_n( &_header->retired, __ATOMIC_ACQUIRE ) ){
+        if( attach() ){
+          return 0;
+        }
+      }
+      return __atomic_load_n( &_header->sequence, __ATOMIC_ACQUIRE ) / 2;
+    }
+
+    /// copies the latest version of the content. -errno on failure.
+    int read( std::string& content, uint64_t* version = 0 ){
+      for( ;; ){
+        if( !_header ){
+          const int err = attach();
+          if( err ){
+            return err;
+          }
+        }
+        const uint64_t sequence = __atomic_load_n( &_header->sequence, __ATOMIC_ACQUIRE );
+        if( sequence & 1 ){
+          ::sched_yield();
+          continue;
+        }
+        if( __atomic_load_n( &_header->retired, __ATOMIC_ACQUIRE ) ){
+          close();
+          continue;
+        }
+        const uint64_t size = __atomic_load_n( &_header->size, __ATOMIC_RELAXED );
+        // a torn size is caught by the sequence check below
+        if( size <= _length - shared_header::data ){
+          content.assign( reinterpret_cast< const char* >( _header ) + shared_header::data, size );
+        }
+        __atomic_thread_fence( __ATOMIC_ACQUIRE );
+        if( __atomic_load_n( &_header->sequence, __ATOMIC_RELAXED ) == sequence && size <= _length - shared_header::data ){
+          if( version ){
+            *version = sequence / 2;
+          }
+          return 0;
+        }
+      }
+    }
+
+  private:
+    shared_reader( const shared_reader& );
+    shared_reader& operator=( const shared_reader& );
+
+    /// the handshake. a region replaced meanwhile is gone before it
+    /// can be mapped, then the handshake is repeated.
+    int attach(){
+      close();
+      for( int attempt = 0; ; ++attempt ){
+        char name[256];
+        const ssize_t length = ::getxattr( _path.c_str(), shared_xattr, name, sizeof(name) - 1 );
+        if( length < 0 ){
+          return -errno;
+        }
+        name[ length ] = 0;
+        const int fd = ::shm_open( name, O_RDONLY | O_CLOEXEC, 0 );
+        if( fd < 0 && errno == ENOENT && attempt < 8 ){
+          continue;
+        }
+        if( fd < 0 ){
+          return -errno;
+        }
+        const int err = map( fd );
+        ::close( fd );
+        return err;
+      }
+    }
+
+    int map( int fd ){
+      struct stat st;
+      if( ::fstat( fd, &st ) != 0 ){
+        return -errno;
+      }
+      if( static_cast< size_t >( st.st_size ) < shared_header::data ){
+        return -EPROTO;
+      }
+      void* map = ::mmap( 0, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+      if( map == MAP_FAILED ){
+        return -errno;
+      }
+      const shared_header* header = static_cast< const shared_header* >( map );
+      if( __atomic_load_n( &header->magic, __ATOMIC_ACQUIRE ) != shared_header::magic_value ){
+        ::munmap( map, st.st_size );
+        return -EPROTO;
+      }
+      _header = header;
+      _length = st.st_size;
+      return 0;
+    }
+
+    std::string _path;
+    const shared_header* _header;
+    size_t _length;
+  };
+
+}
+
+#endif
+
+
+
@@ -0,0 +1,167 @@
+
+#ifndef __FUSEKIT__SHARED_REGION_H
+#define __FUSEKIT__SHARED_REGION_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <string>
+#include <utility>
+
+namespace fusekit{
+
+  /// the virtual extended attribute of a shared_file which tells the
+  /// name of its shared_region, the handshake of a shared_reader. it is
+  /// not listed by listxattr.
+  static const char* const shared_xattr = "user.fusekit.shared";
+
+  /// the layout of a shared_region, shared by the daemon and the clients.
+  /// the content follows at shared_header::data.
+  struct shared_header {
+    enum { magic_value = 0x66736b31, data = 64 };
+
+    uint32_t magic;
+    /// set when a larger region replaced this one: the clients repeat
+    /// the handshake.
+    uint32_t retired;
+    /// the seqlock, odd while the content changes. sequence / 2 is the
+    /// version of the content.
+    uint64_t sequence;
+    uint64_t size;
+    uint64_t capacity;
+  };
+
+  /// a posix shared memory object the daemon publishes the content of a
+  /// file in, for clients on the same host which map it read only (see
+  /// shared_reader). there is one writer, the content is protected by a
+  /// seqlock: a reader copies the content and retries if the sequence
+  /// changed meanwhile, so readers never block the writer nor each
+  /// other.
+  struct shared_region {
+    shared_region()
+      : _header( 0 )
+      , _length( 0 ){
+    }
+
+    ~shared_region(){
+      release();
+    }
+
+    /// creates a region for capacity bytes, readable with mode. the
+    /// versions continue after sequence. -errno on failure.
+    int create( size_t capacity, mode_t mode, uint64_t sequence = 0 ){
+      static std::atomic< unsigned > count( 0 );
+      char name[64];
+      ::snprintf( name, sizeof(name), "/fusekit-%d-%u", static_cast< int >( ::getpid() ), count++ );
+      const int fd = ::shm_open( name, O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, mode );
+      if( fd < 0 ){
+        return -errno;
+      }
+      const size_t length = shared_header::data + capacity;
+      void* map = ::ftruncate( fd, length ) == 0
+        ? ::mmap( 0, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 )
+        : MAP_FAILED;
+      const int err = errno;
+      ::close( fd );
+      if( map == MAP_FAILED ){
+        ::shm_unlink( name );
+        return -err;
+      }
+      release();
+      _name = name;
+      _length = length;
+      _header = static_cast< shared_header* >( map );
+      _header->sequence = sequence & ~1ULL;
+      _header->size = 0;
+      _header->capacity = capacity;
+      __atomic_store_n( &_header->magic, static_cast< uint32_t >( shared_header::magic_value ), __ATOMIC_RELEASE );
+      return 0;
+    }
+
+    /// the name for shm_open(3), empty without a region.
+    const std::string& name() const {
+      return _name;
+    }
+
+    bool valid() const {
+      return _header != 0;
+    }
+
+    size_t capacity() const {
+      return _header ? _header->capacity : 0;
+    }
+
+    size_t size() const {
+      return _header ? _header->size : 0;
+    }
+
+    uint64_t sequence() const {
+      return _header ? _header->sequence : 0;
+    }
+
+    /// the content, for the writer.
+    char* data(){
+      return reinterpret_cast< char* >( _header ) + shared_header::data;
+    }
+
+    /// starts a change of the content: readers retry until end.
+    void begin(){
+      __atomic_store_n( &_header->sequence, _header->sequence + 1, __ATOMIC_RELAXED );
+      __atomic_thread_fence( __ATOMIC_RELEASE );
+    }
+
+    /// completes a change, the content has size bytes now.
+    void end( size_t size ){
+      __atomic_store_n( &_header->size, static_cast< uint64_t >( size ), __ATOMIC_RELAXED );
+      __atomic_store_n( &_header->sequence, _header->sequence + 1, __ATOMIC_RELEASE );
+    }
+
+    /// hands the clients over to a new region: they see retired, repeat
+    /// the handshake and find the new one. the mappings of the clients
+    /// stay valid until they unmap them.
+    void retire(){
+      if( _header ){
+        __atomic_store_n( &_header->retired, 1U, __ATOMIC_RELEASE );
+        begin();
+        end( _header->size );
+      }
+      release();
+    }
+
+    void swap( shared_region& other ){
+      std::swap( _name, other._name );
+      std::swap( _header, other._header );
+      std::swap( _length, other._length );
+    }
+
+  private:
+    shared_region( const shared_region& );
+    shared_region& operator=( const shared_region& );
+
+    void release(){
+      if( _header ){
+        ::munmap( _header, _length );
+        ::shm_unlink( _name.c_str() );
+      }
+      _header = 0;
+      _length = 0;
+      _name.clear();
+    }
+
+    std::string _name;
+    shared_header* _header;
+    size_t _length;
+  };
+
+}
+
+#endif
+
+
+
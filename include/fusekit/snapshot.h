@@ -0,0 +1,688 @@
+
+#ifndef __FUSEKIT__SNAPSHOT_H
+#define __FUSEKIT__SNAPSHOT_H
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+#include <fusekit/entry.h>
+#include <fusekit/basic_file.h>
+#include <fusekit/basic_symlink.h>
+#include <fusekit/basic_directory.h>
+#include <fusekit/child_index.h>
+#include <fusekit/change_log.h>
+#include <fusekit/page_store.h>
+#include <fusekit/reclaim.h>
+#include <fusekit/snapshot_set.h>
+#include <fusekit/virtual_node.h>
+
+namespace fusekit{
+
+  /// time policy of the entries of a snapshot: the times of the
+  /// original when the snapshot was taken.
+  template<
+    class Derived
+    >
+  struct frozen_time
+    : public frozen_entry {
+    void capture_times( const struct stat& st ){
+      _change_time = st.st_ctim;
+      _modification_time = st.st_mtim;
+      _access_time = st.st_atim;
+    }
+
+    timespec modification_time(){
+      return _modification_time;
+    }
+
+    timespec change_time(){
+      return _change_time;
+    }
+
+    timespec access_time(){
+      return _access_time;
+    }
+
+    void update( int ){
+    }
+
+  private:
+    struct timespec _change_time;
+    struct timespec _modification_time;
+    struct timespec _access_time;
+  };
+
+  /// permission policy of the entries of a snapshot: the mode of the
+  /// original, which cannot be changed.
+  template<
+    class Derived
+    >
+  struct frozen_permissions {
+    frozen_permissions()
+      : _current( 0 ){
+    }
+
+    void capture_mode( mode_t mode ){
+      _current = mode & 07777;
+    }
+
+    int access( int permissions ){
+      if( permissions & W_OK ){
+        return -EROFS;
+      }
+      return permissions & ~_current ? -EACCES : 0;
+    }
+
+    int chmod( mode_t ){
+      return -EROFS;
+    }
+
+    int mode(){
+      return _current;
+    }
+
+  private:
+    int _current;
+  };
+
+  /// attributes policy of the entries of a snapshot: the extended
+  /// attributes of the original, which cannot be changed.
+  template<
+    class Derived
+    >
+  struct frozen_xattr {
+    void capture_attributes( entry& original ){
+      const int size = original.listxattr( 0, 0 );
+      if( size <= 0 ){
+        return;
+      }
+      std::vector< char > names( size );
+      if( original.listxattr( &names[0], names.size() ) != size ){
+        return;
+      }
+      for( size_t i = 0; i < names.size(); i += ::strlen( &names[i] ) + 1 ){
+        const int length = original.getxattr( &names[i], 0, 0 );
+        std::vector< char > value( length > 0 ? length : 0 );
+        if( length >= 0 && original.getxattr( &names[i], value.empty() ? 0 : &value[0], value.size() ) == length ){
+          _attributes[ &names[i] ] = value;
+        }
+      }
+    }
+
+    int setxattr( const char*, const char*, size_t, int ){
+      return -EROFS;
+    }
+
+    int getxattr( const char* name, char* value, size_t size ){
+      attributes_t::const_iterator i = _attributes.find( name );
+      if( i == _attributes.end() ){
+        return -ENODATA;
+      }
+      if( size != 0 ){
+        if( i->second.size() > size ){
+          return -ERANGE;
+        }
+        std::copy( i->second.begin(), i->second.end(), value );
+      }
+      return i->second.size();
+    }
+
+    int listxattr( char* list, size_t size ){
+      size_t needed = 0;
+      for( attributes_t::const_iterator i = _attributes.begin(); i != _attributes.end(); ++i ){
+        needed += i->first.size() + 1;
+      }
+      if( size != 0 ){
+        if( needed > size ){
+          return -ERANGE;
+        }
+        for( attributes_t::const_iterator i = _attributes.begin(); i != _attributes.end(); ++i ){
+          list = std::copy( i->first.begin(), i->first.end(), list );
+          *(list++) = 0;
+        }
+      }
+      return needed;
+    }
+
+    int removexattr( const char* ){
+      return -EROFS;
+    }
+
+  private:
+    typedef std::map< std::string, std::vector< char > > attributes_t;
+    attributes_t _attributes;
+  };
+
+  /// buffer policy of the files of a snapshot. the content of memory
+  /// backed originals (page_store) is shared page by page and copied
+  /// only when the original changes, the content of other files is
+  /// copied (up to their st_size, generated files may report none).
+  template<
+    class Derived
+    >
+  struct frozen_buffer
+    : public page_store {
+
+    frozen_buffer()
+      : _error( 0 ){
+    }
+
+    /// takes the content of original. budget is the number of bytes
+    /// which may still be copied, it is reduced by the copy. -EFBIG if
+    /// the content would exceed it, -errno on other failures.
+    int capture_content( entry& original, const struct stat& st, off_t& budget ){
+      page_store* store = dynamic_cast< page_store* >( &original );
+      if( store ){
+        const ssize_t copied = store->copy_to( *this, 0, 0, st.st_size );
+        return copied < 0 ? copied : 0;
+      }
+      if( st.st_size > budget ){
+        return -EFBIG;
+      }
+      budget -= st.st_size;
+      fuse_file_info fi;
+      ::memset( &fi, 0, sizeof(fi) );
+      fi.flags = O_RDONLY;
+      int err = original.open( fi );
+      if( err ){
+        return err;
+      }
+      std::vector< char > chunk( 128 * 1024 );
+      for( off_t offset = 0; offset < st.st_size; ){
+        const int res = original.read( &chunk[0], std::min< off_t >( chunk.size(), st.st_size - offset ), offset, fi );
+        if( res <= 0 ){
+          err = res;
+          break;
+        }
+        err = page_store::write( &chunk[0], res, offset );
+        if( err < 0 ){
+          break;
+        }
+        err = 0;
+        offset += res;
+      }
+      original.release( fi );
+      return err;
+    }
+
+    /// the content could not be taken, opening the file gives err.
+    void capture_error( int err ){
+      _error = err;
+    }
+
+    int open( fuse_file_info& fi ){
+      if( _error ){
+        return _error;
+      }
+      return ( fi.flags & O_ACCMODE ) == O_RDONLY ? 0 : -EROFS;
+    }
+
+    int close( fuse_file_info& ){
+      return 0;
+    }
+
+    int read( char* buf, size_t size, off_t offset, fuse_file_info& ){
+      return page_store::read( buf, size, offset );
+    }
+
+    int write( const char*, size_t, off_t, fuse_file_info& ){
+      return -EROFS;
+    }
+
+    int truncate( off_t ){
+      return -EROFS;
+    }
+
+    int flush( fuse_file_info& ){
+      return 0;
+    }
+
+    int fallocate( int, off_t, off_t, fuse_file_info& ){
+      return -EROFS;
+    }
+
+    off_t lseek( off_t offset, int whence, fuse_file_info& ){
+      return page_store::seek( offset, whence );
+    }
+
+    int readlink( char*, size_t ){
+      return -EINVAL;
+    }
+
+    /// restores into a memory backed file by sharing the pages.
+    ssize_t copy_file_range( fuse_file_info&, off_t off_in, entry& out, fuse_file_info&, off_t off_out, size_t len, int flags ){
+      if( flags ){
+        return -EINVAL;
+      }
+      page_store* target = dynamic_cast< page_store* >( &out );
+      if( !target ){
+        return -EOPNOTSUPP;
+      }
+      const ssize_t copied = copy_to( *target, off_in, off_out, len );
+      if( copied > 0 ){
+        change_log::instance().record( change_write );
+      }
+      return copied;
+    }
+
+  private:
+    int _error;
+  };
+
+  /// a snapshot of a tree, copied on write (see snapshot_node).
+  ///
+  /// taking it copies nothing. an entry of the tree is copied into a
+  /// frozen entry when the snapshot first reads it, or before it
+  /// changes (see snapshot_set), whichever comes first: until then it
+  /// still has the state it had when the snapshot was taken. a frozen
+  /// directory keeps the names and the original entries of its
+  /// children and looks their copies up in the snapshot, so the copies
+  /// are made one entry at a time.
+  struct snapshot
+    : public snapshot_set::member {
+
+    /// a snapshot of root, which may copy budget bytes from files which
+    /// are not memory backed.
+    snapshot( entry& root, off_t budget )
+      : _root( &root )
+      , _budget( budget )
+      , _set( 0 ){
+    }
+
+    ~snapshot(){
+      leave();
+      for( frozen_t::const_iterator i = _frozen.begin(); i != _frozen.end(); ++i ){
+        delete i->second;
+      }
+    }
+
+    /// starts to follow the changes announced to set.
+    void join( snapshot_set& set ){
+      _set = &set;
+      set.add( this );
+    }
+
+    /// stops following the changes, the entries not copied yet are lost.
+    void leave(){
+      if( _set ){
+        _set->remove( this );
+        _set = 0;
+      }
+    }
+
+    /// the root of the snapshot, 0 if it could not be copied.
+    entry* root(){
+      return resolve( *_root );
+    }
+
+    /// the copy of original, which is taken now if the snapshot has not
+    /// copied it yet.
+    entry* resolve( entry& original ){
+      std::lock_guard< std::mutex > guard( _mutex );
+      return copy( original );
+    }
+
+    void preserve( entry& e ){
+      std::lock_guard< std::mutex > guard( _mutex );
+      if( !_created.count( &e ) ){
+        copy( e );
+      }
+    }
+
+    void removed( entry& e ){
+      std::lock_guard< std::mutex > guard( _mutex );
+      if( !_created.erase( &e ) ){
+        copy( e );
+      }
+    }
+
+    void created( entry& e ){
+      std::lock_guard< std::mutex > guard( _mutex );
+      _created.insert( &e );
+    }
+
+  private:
+    snapshot( const snapshot& );
+    snapshot& operator=( const snapshot& );
+
+    typedef std::map< entry*, entry* > frozen_t;
+
+    /// requires _mutex to be held.
+    entry* copy( entry& original ){
+      frozen_t::const_iterator i = _frozen.find( &original );
+      if( i != _frozen.end() ){
+        return i->second;
+      }
+      struct stat st;
+      ::memset( &st, 0, sizeof(st) );
+      if( original.stat( st ) != 0 ){
+        return 0;
+      }
+      entry* frozen = capture( original, st );
+      if( frozen ){
+        _frozen[ &original ] = frozen;
+      }
+      return frozen;
+    }
+
+    /// the frozen copy of original, 0 for entries a snapshot leaves out.
+    entry* capture( entry& original, const struct stat& st );
+
+    entry* _root;
+    std::mutex _mutex;
+    frozen_t _frozen;
+    /// the entries created after the snapshot was taken.
+    std::set< entry* > _created;
+    off_t _budget;
+    snapshot_set* _set;
+  };
+
+  /// node policy of the directories of a snapshot: the names and the
+  /// original entries of the children, whose copies are looked up in the
+  /// snapshot.
+  template<
+    class Derived
+    >
+  struct frozen_node
+    : public virtual_node {
+
+    frozen_node()
+      : _snapshot( 0 ){
+    }
+
+    void bind( snapshot& s ){
+      _snapshot = &s;
+    }
+
+    void add( const std::string& name, entry* original ){
+      _children[ name ] = original;
+    }
+
+    entry* find( const char* name ){
+      children_t::const_iterator i = _children.find( name );
+      return i == _children.end() ? 0 : _snapshot->resolve( *i->second );
+    }
+
+    int readdir( void* buf, fill_dir_t filler, off_t offset, fuse_file_info& ){
+      filler( buf, ".", NULL, offset );
+      filler( buf, "..", NULL, offset );
+      for( children_t::const_iterator i = _children.begin(); i != _children.end(); ++i ){
+        filler( buf, i->first.c_str(), NULL, offset );
+      }
+      return 0;
+    }
+
+    int scan( const std::string& prefix, child_visitor& visitor ){
+      children_t::const_iterator i = _children.lower_bound( prefix );
+      for( ; i != _children.end() && i->first.compare( 0, prefix.size(), prefix ) == 0; ++i ){
+        entry* child = _snapshot->resolve( *i->second );
+        if( child ){
+          visitor( i->first, child );
+        }
+      }
+      return 0;
+    }
+
+  private:
+    typedef std::map< std::string, entry* > children_t;
+    snapshot* _snapshot;
+    children_t _children;
+  };
+
+  typedef basic_directory< frozen_node, frozen_time, frozen_permissions, frozen_xattr > frozen_directory;
+  typedef basic_file< frozen_buffer, frozen_time, frozen_permissions, frozen_xattr > frozen_file;
+  typedef basic_symlink< frozen_time, frozen_permissions, frozen_xattr > frozen_symlink;
+
+  inline
+  entry* snapshot::capture( entry& original, const struct stat& st ){
+    if( S_ISDIR( st.st_mode ) ){
+      struct listing : public child_visitor {
+        listing( frozen_directory& d, const std::set< entry* >& created )
+          : directory( d )
+          , skipped( created ){
+        }
+        void operator()( const std::string& name, entry* child ){
+          if( child && snapshot_set::preservable( *child ) && !skipped.count( child ) ){
+            directory.add( name, child );
+          }
+        }
+        frozen_directory& directory;
+        const std::set< entry* >& skipped;
+      };
+      frozen_directory* d = new frozen_directory;
+      d->bind( *this );
+      d->capture_times( st );
+      d->capture_mode( st.st_mode );
+      d->capture_attributes( original );
+      listing children( *d, _created );
+      original.scan( "", children );
+      return d;
+    }
+    if( S_ISLNK( st.st_mode ) ){
+      char target[ 4096 ] = { 0 };
+      if( original.readlink( target, sizeof(target) - 1 ) != 0 ){
+        return 0;
+      }
+      frozen_symlink* l = new frozen_symlink( target );
+      l->capture_times( st );
+      l->capture_mode( st.st_mode );
+      l->capture_attributes( original );
+      return l;
+    }
+    if( S_ISREG( st.st_mode ) ){
+      frozen_file* f = new frozen_file;
+      const int err = f->capture_content( original, st, _budget );
+      if( err ){
+        f->capture_error( err );
+      }
+      f->capture_times( st );
+      f->capture_mode( st.st_mode );
+      f->capture_attributes( original );
+      return f;
+    }
+    return 0;
+  }
+
+  /// node policy of a directory of snapshots of a tree, e.g.
+  /// /.snapshots, where every snapshot is a read only subtree:
+  ///
+  ///   root.add_directory( ".snapshots", make_snapshot_directory( root ) );
+  ///   mkdir /mnt/.snapshots/nightly     # takes a snapshot
+  ///   tar -C /mnt/.snapshots/nightly -c .
+  ///   rmdir /mnt/.snapshots/nightly     # drops it
+  ///
+  /// taking a snapshot costs constant time, the entries are copied on
+  /// write (see snapshot): an entry is copied before the tree changes
+  /// it or when the snapshot first reads it. the content of memory
+  /// backed files (page_store) is shared page by page until the tree
+  /// changes it. the content of other files is read and copied, up to
+  /// the copy limit of the snapshot directory (64 MiB by default),
+  /// beyond which opening a copy fails with EFBIG.
+  ///
+  /// the snapshot sees the changes which directory_node and the daemon
+  /// announce to the snapshot_set of the daemon. it takes them in the
+  /// order the daemon runs the operations, so it is consistent as long
+  /// as the tree changes through them only. content the application
+  /// changes behind the daemon, or generates (a file whose content is
+  /// computed when it is read), is seen as it is when the snapshot first
+  /// reads the entry. generated directories (virtual_node), like the
+  /// snapshots themselves, are left out. a snapshot taken by calling
+  /// take, not by a mkdir, has to be taken in a daemon::scope.
+  template<
+    class Derived
+    >
+  struct snapshot_node
+    : public virtual_node {
+
+    snapshot_node()
+      : _root( 0 )
+      , _next( 1 )
+      , _copy_limit( 64 * 1024 * 1024 ){
+    }
+
+    ~snapshot_node(){
+      for( snapshots_t::const_iterator i = _snapshots.begin(); i != _snapshots.end(); ++i ){
+        delete i->second;
+      }
+    }
+
+    void bind( entry& root ){
+      _root = &root;
+    }
+
+    /// the bytes a snapshot may copy from files which are not memory
+    /// backed.
+    void copy_limit( off_t bytes ){
+      std::lock_guard< std::mutex > guard( _mutex );
+      _copy_limit = bytes;
+    }
+
+    /// takes a snapshot of the tree named name. -errno on failure.
+    int take( const std::string& name ){
+      if( !_root ){
+        return -ENOENT;
+      }
+      if( name.empty() || name.find( '/' ) != std::string::npos ){
+        return -EINVAL;
+      }
+      off_t budget;
+      {
+        std::lock_guard< std::mutex > guard( _mutex );
+        if( _snapshots.count( name ) ){
+          return -EEXIST;
+        }
+        budget = _copy_limit;
+      }
+      snapshot* s = new snapshot( *_root, budget );
+      s->join( snapshot_set::instance() );
+      std::lock_guard< std::mutex > guard( _mutex );
+      if( !_snapshots.insert( std::make_pair( name, s ) ).second ){
+        delete s;
+        return -EEXIST;
+      }
+      return 0;
+    }
+
+    /// takes a snapshot named by a number, its name or empty on failure.
+    std::string take(){
+      for( ;; ){
+        char name[32];
+        {
+          std::lock_guard< std::mutex > guard( _mutex );
+          ::snprintf( name, sizeof(name), "%lu", _next++ );
+        }
+        const int err = take( name );
+        if( err == 0 ){
+          return name;
+        }
+        if( err != -EEXIST ){
+          return std::string();
+        }
+      }
+    }
+
+    /// drops the snapshot name. operations running in it may still
+    /// use it, so it is retired (see reclaim).
+    int remove( const std::string& name ){
+      snapshot* s;
+      {
+        std::lock_guard< std::mutex > guard( _mutex );
+        snapshots_t::iterator i = _snapshots.find( name );
+        if( i == _snapshots.end() ){
+          return -ENOENT;
+        }
+        s = i->second;
+        _snapshots.erase( i );
+      }
+      s->leave();
+      reclaim::retire( s );
+      return 0;
+    }
+
+    entry* find( const char* name ){
+      snapshot* s;
+      {
+        std::lock_guard< std::mutex > guard( _mutex );
+        snapshots_t::const_iterator i = _snapshots.find( name );
+        if( i == _snapshots.end() ){
+          return 0;
+        }
+        s = i->second;
+      }
+      return s->root();
+    }
+
+    int readdir( void* buf, fill_dir_t filler, off_t offset, fuse_file_info& ){
+      std::vector< std::string > names;
+      {
+        std::lock_guard< std::mutex > guard( _mutex );
+        for( snapshots_t::const_iterator i = _snapshots.begin(); i != _snapshots.end(); ++i ){
+          names.push_back( i->first );
+        }
+      }
+      filler( buf, ".", NULL, offset );
+      filler( buf, "..", NULL, offset );
+      for( size_t i = 0; i < names.size(); ++i ){
+        filler( buf, names[i].c_str(), NULL, offset );
+      }
+      return 0;
+    }
+
+    int scan( const std::string& prefix, child_visitor& visitor ){
+      std::vector< std::pair< std::string, snapshot* > > found;
+      {
+        std::lock_guard< std::mutex > guard( _mutex );
+        snapshots_t::const_iterator i = _snapshots.lower_bound( prefix );
+        for( ; i != _snapshots.end() && i->first.compare( 0, prefix.size(), prefix ) == 0; ++i ){
+          found.push_back( *i );
+        }
+      }
+      for( size_t i = 0; i < found.size(); ++i ){
+        entry* root = found[i].second->root();
+        if( root ){
+          visitor( found[i].first, root );
+        }
+      }
+      return 0;
+    }
+
+    int mkdir( const char* name, mode_t ){
+      return take( name );
+    }
+
+    int rmdir( const char* name ){
+      return remove( name );
+    }
+
+  private:
+    typedef std::map< std::string, snapshot* > snapshots_t;
+
+    entry* _root;
+    std::mutex _mutex;
+    snapshots_t _snapshots;
+    unsigned long _next;
+    off_t _copy_limit;
+  };
+
+  typedef basic_directory< snapshot_node > snapshot_directory;
+
+  /// a directory of snapshots of the tree of root, to be added below it.
+  inline
+  snapshot_directory* make_snapshot_directory( entry& root ){
+    snapshot_directory* s = new snapshot_directory;
+    s->bind( root );
+    return s;
+  }
+
+}
+
+#endif
+
+
+
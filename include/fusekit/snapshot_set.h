@@ -0,0 +1,163 @@
+
+#ifndef __FUSEKIT__SNAPSHOT_SET_H
+#define __FUSEKIT__SNAPSHOT_SET_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <fusekit/entry.h>
+#include <fusekit/child_index.h>
+#include <fusekit/virtual_node.h>
+
+namespace fusekit{
+
+  /// marks the entries of a snapshot, which never change.
+  struct frozen_entry {
+  };
+
+  /// the copy on write snapshots of a tree (see snapshot_node).
+  ///
+  /// a snapshot keeps the state an entry had when the snapshot was
+  /// taken. it copies the entry when it first reads it, or right before
+  /// the entry changes: the directories call preserve before their
+  /// children change and removed before they delete a child, the daemon
+  /// calls preserve before it changes the content or the attributes of
+  /// an entry. without snapshots these calls cost an atomic load.
+  ///
+  /// like the change_log, every daemon owns a set and makes it current
+  /// while it runs an operation. generated directories (virtual_node)
+  /// and the entries of the snapshots themselves are never preserved.
+  struct snapshot_set {
+    /// a snapshot in the set.
+    struct member {
+      virtual ~member(){
+      }
+      /// e is about to change.
+      virtual void preserve( entry& e ) = 0;
+      /// e is about to be removed from its directory, which may delete it.
+      virtual void removed( entry& e ) = 0;
+      /// e has been created, after the snapshot was taken.
+      virtual void created( entry& e ) = 0;
+    };
+
+    snapshot_set()
+      : _size( 0 ){
+    }
+
+    /// the current set of the thread, a process wide set outside of a
+    /// scope.
+    static snapshot_set& instance(){
+      static snapshot_set s;
+      snapshot_set* c = current();
+      return c ? *c : s;
+    }
+
+    /// makes set the current set of this thread.
+    struct scope {
+      explicit scope( snapshot_set& set )
+        : _previous( current() ){
+        current() = &set;
+      }
+
+      ~scope(){
+        current() = _previous;
+      }
+
+    private:
+      scope( const scope& );
+      scope& operator=( const scope& );
+      snapshot_set* _previous;
+    };
+
+    void add( member* m ){
+      std::lock_guard< std::mutex > guard( _mutex );
+      _members.push_back( m );
+      _size.store( _members.size(), std::memory_order_release );
+    }
+
+    void remove( member* m ){
+      std::lock_guard< std::mutex > guard( _mutex );
+      _members.erase( std::remove( _members.begin(), _members.end(), m ), _members.end() );
+      _size.store( _members.size(), std::memory_order_release );
+    }
+
+    void preserve( entry& e ){
+      if( empty() || !preservable( e ) ){
+        return;
+      }
+      std::lock_guard< std::mutex > guard( _mutex );
+      for( size_t i = 0; i < _members.size(); ++i ){
+        _members[i]->preserve( e );
+      }
+    }
+
+    /// e and everything below it are about to be removed.
+    void removed( entry& e ){
+      if( empty() || !preservable( e ) ){
+        return;
+      }
+      std::lock_guard< std::mutex > guard( _mutex );
+      remove_tree( e );
+    }
+
+    void created( entry& e ){
+      if( empty() || !preservable( e ) ){
+        return;
+      }
+      std::lock_guard< std::mutex > guard( _mutex );
+      for( size_t i = 0; i < _members.size(); ++i ){
+        _members[i]->created( e );
+      }
+    }
+
+    /// false for the entries a snapshot leaves out.
+    static bool preservable( entry& e ){
+      return !dynamic_cast< virtual_node* >( &e ) && !dynamic_cast< frozen_entry* >( &e );
+    }
+
+  private:
+    snapshot_set( const snapshot_set& );
+    snapshot_set& operator=( const snapshot_set& );
+
+    struct tree_collector : public child_visitor {
+      void operator()( const std::string&, entry* child ){
+        if( child && preservable( *child ) ){
+          children.push_back( child );
+        }
+      }
+      std::vector< entry* > children;
+    };
+
+    bool empty() const {
+      return _size.load( std::memory_order_acquire ) == 0;
+    }
+
+    /// requires _mutex to be held.
+    void remove_tree( entry& e ){
+      tree_collector collector;
+      e.scan( "", collector );
+      for( size_t i = 0; i < collector.children.size(); ++i ){
+        remove_tree( *collector.children[i] );
+      }
+      for( size_t i = 0; i < _members.size(); ++i ){
+        _members[i]->removed( e );
+      }
+    }
+
+    static snapshot_set*& current(){
+      static thread_local snapshot_set* c = 0;
+      return c;
+    }
+
+    std::mutex _mutex;
+    std::vector< member* > _members;
+    std::atomic< size_t > _size;
+  };
+
+}
+
+#endif
+
+
@@ -0,0 +1,380 @@
+
+#ifndef __FUSEKIT__STATIC_DIRECTORY_H
+#define __FUSEKIT__STATIC_DIRECTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+#include <fusekit/entry.h>
+#include <fusekit/child_index.h>
+#include <fusekit/basic_directory.h>
+#include <fusekit/usage.h>
+#include <fusekit/subtree.h>
+
+/// declares a type id which carries the compile time name of a child
+/// of a static_directory, e.g. FUSEKIT_STATIC_NAME( readme, "README" );
+#define FUSEKIT_STATIC_NAME( id, name )                         \
+  struct id {                                                   \
+    static constexpr const char* value(){ return name; }        \
+  }
+
+namespace fusekit{
+
+  /// FNV-1a hash of a name, usable at compile and at run time.
+  constexpr uint64_t static_name_fnv( const char* name, uint64_t h = 0xcbf29ce484222325ULL ){
+    return *name ? static_name_fnv( name + 1, ( h ^ static_cast< unsigned char >( *name ) ) * 0x100000001b3ULL ) : h;
+  }
+
+  constexpr uint64_t static_name_fold( uint64_t h, unsigned int shift ){
+    return h ^ ( h >> shift );
+  }
+
+  /// the hash of a name: FNV-1a followed by the finalizer of MurmurHash3,
+  /// which spreads every bit over the low ones the table is indexed by.
+  /// the finalizer is a bijection, distinct FNV hashes stay distinct.
+  constexpr uint64_t static_name_hash( const char* name ){
+    return static_name_fold(
+      static_name_fold(
+        static_name_fold( static_name_fnv( name ), 33 ) * 0xff51afd7ed558ccdULL, 33 ) * 0xc4ceb9fe1a85ec53ULL, 33 );
+  }
+
+  /// a child of a static_directory: the entry of type Entry named Name::value().
+  /// Entry has to be default constructible.
+  template< class Name, class Entry >
+  struct static_entry {
+    typedef Name name;
+    typedef Entry type;
+  };
+
+  /// compile time construction of the lookup table of a static directory.
+  ///
+  /// the table maps hash % modulus to the position of the child + 1 (0 is
+  /// a free slot). modulus is the smallest number which maps the hashes
+  /// of all names onto distinct slots, so lookups need a single probe.
+  namespace static_table{
+
+    constexpr bool unequal( uint64_t ){
+      return true;
+    }
+
+    template< class... Hashes >
+    constexpr bool unequal( uint64_t h, uint64_t first, Hashes... rest ){
+      return h != first && unequal( h, rest... );
+    }
+
+    /// true if the hashes are pairwise different.
+    constexpr bool unique(){
+      return true;
+    }
+
+    template< class... Hashes >
+    constexpr bool unique( uint64_t first, Hashes... rest ){
+      return unequal( first, rest... ) && unique( rest... );
+    }
+
+    constexpr bool differs( uint64_t, uint64_t ){
+      return true;
+    }
+
+    template< class... Hashes >
+    constexpr bool differs( uint64_t m, uint64_t h, uint64_t first, Hashes... rest ){
+      return h % m != first % m && differs( m, h, rest... );
+    }
+
+    constexpr bool distinct( uint64_t ){
+      return true;
+    }
+
+    template< class... Hashes >
+    constexpr bool distinct( uint64_t m, uint64_t first, Hashes... rest ){
+      return differs( m, first, rest... ) && distinct( m, rest... );
+    }
+
+    template< class... Hashes >
+    constexpr uint64_t modulus( uint64_t lo, uint64_t hi, Hashes... h );
+
+    /// found if it is a modulus, else the smallest one in [lo,hi]: the
+    /// upper half is only searched if the lower one has none.
+    template< class... Hashes >
+    constexpr uint64_t modulus_above( uint64_t found, uint64_t lo, uint64_t hi, Hashes... h ){
+      return found ? found : modulus( lo, hi, h... );
+    }
+
+    /// the smallest modulus in [lo,hi] or 0. bisects to keep
+    /// the recursion depth logarithmic.
+    template< class... Hashes >
+    constexpr uint64_t modulus( uint64_t lo, uint64_t hi, Hashes... h ){
+      return lo == hi
+        ? ( distinct( lo, h... ) ? lo : 0 )
+        : modulus_above( modulus( lo, ( lo + hi ) / 2, h... ), ( lo + hi ) / 2 + 1, hi, h... );
+    }
+
+    constexpr unsigned int position( uint64_t, uint64_t, unsigned int ){
+      return 0;
+    }
+
+    /// position + 1 of the name which is placed into slot, or 0.
+    template< class... Hashes >
+    constexpr unsigned int position( uint64_t m, uint64_t slot, unsigned int i, uint64_t first, Hashes... rest ){
+      return first % m == slot ? i + 1 : position( m, slot, i + 1, rest... );
+    }
+
+    template< size_t... I >
+    struct indices {
+      typedef indices< I..., ( sizeof...(I) + I )... > doubled;
+      typedef indices< I..., ( sizeof...(I) + I )..., 2 * sizeof...(I) > doubled_plus_one;
+    };
+
+    template< size_t N >
+    struct make_indices {
+      typedef typename make_indices< N / 2 >::type half;
+      typedef typename std::conditional< N % 2, typename half::doubled_plus_one, typename half::doubled >::type type;
+    };
+
+    template<>
+    struct make_indices< 0 > {
+      typedef indices<> type;
+    };
+
+    template< uint64_t M, class Indices, uint64_t... Hashes >
+    struct table;
+
+    template< uint64_t M, size_t... Slots, uint64_t... Hashes >
+    struct table< M, indices< Slots... >, Hashes... > {
+      static const unsigned short slots[ M ];
+    };
+
+    template< uint64_t M, size_t... Slots, uint64_t... Hashes >
+    const unsigned short table< M, indices< Slots... >, Hashes... >::slots[ M ] = {
+      static_cast< unsigned short >( position( M, Slots, 0, Hashes... ) )...
+    };
+
+  }
+
+  /// holds the entry of a child as a member.
+  template< class Child >
+  struct static_slot {
+    typename Child::type value;
+  };
+
+  template< class Name, class... Children >
+  struct static_child_of;
+
+  template< class Name, class Entry, class... Children >
+  struct static_child_of< Name, static_entry< Name, Entry >, Children... > {
+    typedef static_entry< Name, Entry > type;
+  };
+
+  template< class Name, class Child, class... Children >
+  struct static_child_of< Name, Child, Children... >
+    : public static_child_of< Name, Children... >{
+  };
+
+  /// node policy of a directory whose children are fixed at compile time.
+  ///
+  /// the children are members of the directory. get< Name >() returns
+  /// a child with its concrete type, so calls on it are statically
+  /// dispatched. the run time lookup by name (the daemon's path
+  /// resolution) hashes the name once and probes a table which has been
+  /// computed at compile time. children cannot be created or removed.
+  template<
+    class Derived,
+    class... Children
+    >
+  struct static_directory_node
+    : public static_slot< Children >... {
+
+    static const size_t child_count = sizeof...(Children);
+
+    static_directory_node()
+      : _entries{ static_cast< entry* >( &static_cast< static_slot< Children >& >(*this).value )... }
+      , _subtree( subtree_size( 1 ) ){
+      usage::instance().add_directories( 1 );
+      for( size_t i = 0; i < child_count; ++i ){
+        _subtree.change( _entries[i]->adopted( self() ) );
+      }
+    }
+
+    ~static_directory_node(){
+      usage::instance().add_directories( -1 );
+      for( size_t i = 0; i < child_count; ++i ){
+        _entries[i]->orphaned( self() );
+      }
+    }
+
+    template< class Name >
+    typename static_child_of< Name, Children... >::type::type& get(){
+      return static_cast< static_slot< typename static_child_of< Name, Children... >::type >& >(*this).value;
+    }
+
+    entry* find( const char* name ) {
+      const unsigned int position = table::slots[ static_name_hash( name ) % modulus ];
+      if( position && ::strcmp( names()[ position - 1 ], name ) == 0 ){
+        return _entries[ position - 1 ];
+      }
+      return 0;
+    }
+
+    int links() {
+      return child_count + 2;
+    }
+
+    int opendir( fuse_file_info& ){
+      return 0;
+    }
+
+    int readdir( void* buf, fill_dir_t filler, off_t offset, fuse_file_info& ){
+      filler( buf, ".", NULL, offset );
+      filler( buf, "..", NULL, offset );
+      for( size_t i = 0; i < child_count; ++i ){
+        filler( buf, names()[i], NULL, offset );
+      }
+      return 0;
+    }
+
+    int releasedir( fuse_file_info& ){
+      return 0;
+    }
+
+    int mknod( const char*, mode_t, dev_t ){
+      return -EROFS;
+    }
+
+    int unlink( const char* ){
+      return -EROFS;
+    }
+
+    int mkdir( const char*, mode_t ){
+      return -EROFS;
+    }
+
+    int rmdir( const char* ){
+      return -EROFS;
+    }
+
+    int symlink( const char*, const char* ){
+      return -EROFS;
+    }
+
+    int rename( const char*, entry&, const char*, unsigned int ){
+      return -EROFS;
+    }
+
+    int attach( const char*, entry* ){
+      return -EROFS;
+    }
+
+    entry* detach( const char* ){
+      return 0;
+    }
+
+    int link( const char*, entry& ){
+      return -EROFS;
+    }
+
+    int hold(){
+      return -EPERM;
+    }
+
+    int drop(){
+      return 0;
+    }
+
+    int scan( const std::string& prefix, child_visitor& visitor ){
+      for( size_t i = 0; i < child_count; ++i ){
+        if( ::strncmp( names()[i], prefix.c_str(), prefix.size() ) == 0 ){
+          visitor( names()[i], _entries[i] );
+        }
+      }
+      return 0;
+    }
+
+    subtree_size subtree(){
+      return _subtree.size() - subtree_size( 1 );
+    }
+
+    subtree_size adopted( entry* parent ){
+      return _subtree.adopt( parent );
+    }
+
+    subtree_size orphaned( entry* parent ){
+      return _subtree.orphan( parent );
+    }
+
+    void add_subtree( const subtree_size& delta ){
+      _subtree.change( delta );
+    }
+
+    /// the children never change.
+    unsigned long generation(){
+      return 1;
+    }
+
+    /// a static directory is immutable already, recursive freezes
+    /// the (dynamic) directories below.
+    int freeze( bool recursive ){
+      for( size_t i = 0; recursive && i < child_count; ++i ){
+        const int err = _entries[i]->freeze( true );
+        if( err && err != -ENOTDIR ){
+          return err;
+        }
+      }
+      return 0;
+    }
+
+  private:
+    static_assert( sizeof...(Children) > 0, "a static directory needs children" );
+    static_assert( static_table::unique( static_name_hash( Children::name::value() )... ),
+                   "the names of a static directory must be distinct" );
+
+    static constexpr uint64_t modulus =
+      static_table::modulus( sizeof...(Children), sizeof...(Children) * sizeof...(Children) + 1,
+                             static_name_hash( Children::name::value() )... );
+    static_assert( modulus != 0, "no perfect hash for the names of a static directory" );
+
+    typedef static_table::table<
+      modulus,
+      typename static_table::make_indices< modulus >::type,
+      static_name_hash( Children::name::value() )...
+      > table;
+
+    static const char* const* names(){
+      static const char* const n[] = { Children::name::value()... };
+      return n;
+    }
+
+    entry* self(){
+      return &static_cast< Derived& >(*this);
+    }
+
+    entry* _entries[ sizeof...(Children) ];
+    subtree_node _subtree;
+  };
+
+  template< class Derived, class... Children >
+  constexpr uint64_t static_directory_node< Derived, Children... >::modulus;
+
+  /// a directory with the children declared as static_entry< Name, Entry >.
+  ///
+  /// FUSEKIT_STATIC_NAME( a, "a" );
+  /// FUSEKIT_STATIC_NAME( s, "s" );
+  /// typedef static_directory< static_entry< s, my_file > >::type a_dir;
+  /// typedef static_directory< static_entry< a, a_dir >, static_entry< s, my_file > >::type root;
+  template< class... Children >
+  struct static_directory {
+    template<
+      class Derived
+      >
+    struct static_directory_node_alias
+      : public static_directory_node< Derived, Children... >{
+    };
+    typedef basic_directory< static_directory_node_alias > type;
+  };
+
+}
+
+#endif
+
+
+
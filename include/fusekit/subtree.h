@@ -0,0 +1,115 @@
+
+#ifndef __FUSEKIT__SUBTREE_H
+#define __FUSEKIT__SUBTREE_H
+
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <algorithm>
+#include <fusekit/entry.h>
+#include <fusekit/subtree_size.h>
+
+namespace fusekit{
+
+  /// the size of an entry including its subtree, and the parents the
+  /// changes of the size propagate to.
+  ///
+  /// directories add the size of a child when it is adopted and subtract
+  /// it when it is orphaned; every change below is passed up the parents
+  /// as a delta. so the totals of any directory are available in O(1),
+  /// while a change costs O(depth). a hard linked file counts once in
+  /// each directory it is linked into, however many names it has there.
+  ///
+  /// the changes of an entry are passed up while its lock is held, so a
+  /// parent receives each change either as part of the size returned by
+  /// adopt or as a delta, never both. locks are taken from the children
+  /// up to the root only.
+  struct subtree_node {
+    explicit subtree_node( const subtree_size& own )
+      : _size( own ){
+    }
+
+    subtree_size size(){
+      std::lock_guard< std::mutex > guard( _mutex );
+      return _size;
+    }
+
+    /// registers a link from parent and returns the size it has to add,
+    /// which is empty if parent already links the entry.
+    subtree_size adopt( entry* parent ){
+      std::lock_guard< std::mutex > guard( _mutex );
+      const parents_t::iterator i = std::find_if( _parents.begin(), _parents.end(), is( parent ) );
+      if( i != _parents.end() ){
+        ++i->second;
+        return subtree_size();
+      }
+      _parents.push_back( std::make_pair( parent, 1u ) );
+      return _size;
+    }
+
+    /// unregisters a link from parent and returns the size it has to
+    /// subtract, which is empty if parent still links the entry.
+    subtree_size orphan( entry* parent ){
+      std::lock_guard< std::mutex > guard( _mutex );
+      const parents_t::iterator i = std::find_if( _parents.begin(), _parents.end(), is( parent ) );
+      if( i == _parents.end() ){
+        return _size;
+      }
+      if( --i->second ){
+        return subtree_size();
+      }
+      _parents.erase( i );
+      return _size;
+    }
+
+    /// adds delta and propagates it.
+    void change( const subtree_size& delta ){
+      std::lock_guard< std::mutex > guard( _mutex );
+      propagate( delta );
+    }
+
+    /// replaces the size by leaf.own_size(), which is called with the
+    /// lock held, and propagates the difference.
+    template< class Leaf >
+    void refresh( Leaf& leaf ){
+      std::lock_guard< std::mutex > guard( _mutex );
+      propagate( leaf.own_size() - _size );
+    }
+
+  private:
+    typedef std::vector< std::pair< entry*, unsigned int > > parents_t;
+
+    struct is {
+      explicit is( entry* p )
+        : parent( p ){
+      }
+      bool operator()( const parents_t::value_type& v ) const {
+        return v.first == parent;
+      }
+      entry* parent;
+    };
+
+    subtree_node( const subtree_node& );
+    subtree_node& operator=( const subtree_node& );
+
+    void propagate( const subtree_size& delta ){
+      if( delta.empty() ){
+        return;
+      }
+      _size += delta;
+      for( size_t i = 0; i < _parents.size(); ++i ){
+        _parents[i].first->add_subtree( delta );
+      }
+    }
+
+    std::mutex _mutex;
+    parents_t _parents;
+    subtree_size _size;
+  };
+
+}
+
+#endif
+
+
+
@@ -0,0 +1,70 @@
+
+#ifndef __FUSEKIT__SUBTREE_SIZE_H
+#define __FUSEKIT__SUBTREE_SIZE_H
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+namespace fusekit{
+
+  /// the name of the virtual extended attribute which reports the
+  /// subtree_size of a directory, as "entries=<n> bytes=<n> blocks=<n>".
+  /// it is not listed by listxattr, so copies do not pick it up.
+  static const char* const subtree_xattr = "user.fusekit.du";
+
+  /// number of entries, bytes (st_size) and blocks (st_blocks) of a subtree.
+  struct subtree_size {
+    subtree_size( long long e = 0, long long by = 0, long long bl = 0 )
+      : entries( e )
+      , bytes( by )
+      , blocks( bl ){
+    }
+
+    subtree_size& operator+=( const subtree_size& other ){
+      entries += other.entries;
+      bytes += other.bytes;
+      blocks += other.blocks;
+      return *this;
+    }
+
+    subtree_size& operator-=( const subtree_size& other ){
+      entries -= other.entries;
+      bytes -= other.bytes;
+      blocks -= other.blocks;
+      return *this;
+    }
+
+    subtree_size operator-( const subtree_size& other ) const {
+      subtree_size s( *this );
+      return s -= other;
+    }
+
+    bool empty() const {
+      return !entries && !bytes && !blocks;
+    }
+
+    /// getxattr of subtree_xattr.
+    int format( char* value, size_t size ) const {
+      char buf[ 96 ];
+      const int length = ::snprintf( buf, sizeof(buf), "entries=%lld bytes=%lld blocks=%lld", entries, bytes, blocks );
+      if( size != 0 ){
+        if( static_cast< size_t >( length ) > size ){
+          return -ERANGE;
+        }
+        ::memcpy( value, buf, length );
+      }
+      return length;
+    }
+
+    long long entries;
+    long long bytes;
+    long long blocks;
+  };
+
+}
+
+#endif
+
+
+
@@ -3,9 +3,12 @@
 #define __FUSEKIT__SYMLINK_FACTORY_H
 
 #include <string>
-#include <tr1/unordered_map>
 #include <fusekit/no_lock.h>
 #include <fusekit/entry.h>
+#include <fusekit/usage.h>
+#include <fusekit/change_log.h>
+#include <fusekit/child_index.h>
+#include <fusekit/hashed_index.h>
 #include <fusekit/symlink_node.h>
 #include <fusekit/no_creator.h>
 
@@ -14,106 +17,131 @@ namespace fusekit{
   struct no_symlink_creator : public no_creator_arg<const char*>{
   };
 
-  template< class Creator = no_symlink_creator, class LockingPolicy = no_lock >
+  template< class Creator = no_symlink_creator, class LockingPolicy = no_lock, class Index = hashed_index >
   struct symlink_factory : public LockingPolicy{
-    typedef std::tr1::unordered_map< std::string, entry* > map_t;
-    typedef typename file_factory< Creator, LockingPolicy >::lock lock;
+    typedef Index map_t;
+    typedef typename symlink_factory< Creator, LockingPolicy, Index >::lock lock;
+    typedef typename map_t::template read_lock< lock >::type read_lock;
 
     ~symlink_factory() {
       lock guard(*this);
-      map_t::const_iterator e = _added_symlinks.begin();
-      while( e != _added_symlinks.end() ){
-        delete e->second;
-        ++e;
-      }
-      e = _created_symlinks.begin();
-      while( e != _created_symlinks.end() ){
-        delete e->second;
-        ++e;
-      }
+      delete_entries deleter;
+      _added_symlinks.visit( deleter );
+      _created_symlinks.visit( deleter );
     }
 
     entry* find( const char* name ) {
-      lock guard(*this);
-      map_t::const_iterator e = _added_symlinks.find( name );
-      if( e != _added_symlinks.end() ) {
-        return e->second;
-      }
-      e = _created_symlinks.find( name );
-      if( e != _created_symlinks.end() ) {
-        return e->second;
-      }
-      return 0;
+      read_lock guard(*this);
+      return find_locked( name );
     }
 
     template< class Child >
     Child& add_symlink( const char* name, Child* child ) {
       lock guard(*this);
-      const map_t::key_type key( name );
-      map_t::iterator e = _added_symlinks.find( name );
-      if( e != _added_symlinks.end() ) {
-        delete e->second;
+      entry* replaced = _added_symlinks.insert( name, child );
+      if( replaced ) {
+        map_t::retire( replaced );
       }
-      _added_symlinks[ name ] = child;
+      change_log::instance().record( change_add, name );
       return *child;
     }
     
     int size() {
-      lock guard(*this);
+      read_lock guard(*this);
       return _added_symlinks.size() + _created_symlinks.size();
     }
 
     name_container_t names() {
-      lock guard(*this);
+      read_lock guard(*this);
       name_container_t names;
-      map_t::const_iterator i = _added_symlinks.begin();
-      while( i != _added_symlinks.end() ) {
-        names.insert( i->first.c_str() );
-        ++i;
-      }
-      i = _created_symlinks.begin();
-      while( i != _created_symlinks.end() ) {
-        names.insert( i->first.c_str() );
-        ++i;
-      }
+      collect_names collector( names );
+      _added_symlinks.visit( collector );
+      _created_symlinks.visit( collector );
       return names;
     }
 
+    /// calls visitor( name, entry ) for all children.
+    template< class Visitor >
+    void visit( Visitor& visitor ) {
+      read_lock guard(*this);
+      _added_symlinks.visit( visitor );
+      _created_symlinks.visit( visitor );
+    }
+
+    /// calls visitor( name, entry ) for the children whose names start with prefix.
+    template< class Visitor >
+    void visit_prefix( const std::string& prefix, Visitor& visitor ) {
+      read_lock guard(*this);
+      fusekit::visit_prefix( _added_symlinks, prefix, visitor );
+      fusekit::visit_prefix( _created_symlinks, prefix, visitor );
+    }
+
     int create( const char* name, const char* target ){
       lock guard(*this);
-      if( find( name ) ){
+      if( find_locked( name ) ){
         return -EEXIST;
       }
+      const int err = usage::instance().check_inode();
+      if( err ){
+        return err;
+      }
       entry* d = _creator(target);
       if( !d ){
         return -EROFS;
       }
-      _created_symlinks[name] = d;
+      _created_symlinks.insert( name, d );
+      change_log::instance().record( change_create, name );
       return 0;
     }
 
     int destroy( const char* name ){
       lock guard(*this);
-      entry* ep = 0;
-      map_t::const_iterator e = _added_symlinks.find( name );
-      if( e != _added_symlinks.end() ) {
-        ep = e->second;
-        _added_symlinks.erase(e);
-      }
-      else if( (e = _created_symlinks.find( name )) != _created_symlinks.end() ){
-        ep = e->second;
-        _created_symlinks.erase(e);
-      }
-      
+      entry* ep = detach_locked( name );
       if( ep ){
-        delete ep;
+        change_log::instance().record( change_remove, name );
+        map_t::retire( ep );
         return 0;
       }
       else{
         return -ENOENT;
       }
     }
+
+    /// removes the child name without deleting it and returns it or 0.
+    entry* detach( const char* name ){
+      lock guard(*this);
+      return detach_locked( name );
+    }
+
+    /// adds an existing entry as child name. a child with the same name
+    /// is replaced in a single step, so the name never disappears.
+    void attach( const char* name, entry* child ){
+      lock guard(*this);
+      entry* replaced = _added_symlinks.find( name )
+        ? _added_symlinks.insert( name, child )
+        : _created_symlinks.insert( name, child );
+      if( replaced && replaced != child ){
+        map_t::retire( replaced );
+      }
+    }
   private:
+    /// find and detach without taking the lock, for callers holding it.
+    entry* find_locked( const char* name ) {
+      entry* e = _added_symlinks.find( name );
+      if( e ) {
+        return e;
+      }
+      return _created_symlinks.find( name );
+    }
+
+    entry* detach_locked( const char* name ){
+      entry* ep = _added_symlinks.erase( name );
+      if( !ep ){
+        ep = _created_symlinks.erase( name );
+      }
+      return ep;
+    }
+
     Creator _creator;
     map_t _added_symlinks;
     map_t _created_symlinks;
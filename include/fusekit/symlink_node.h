@@ -2,7 +2,12 @@
 #ifndef __FUSEKIT__SYMLINK_NODE_H
 #define __FUSEKIT__SYMLINK_NODE_H
 
+#include <string.h>
+#include <sys/stat.h>
+#include <atomic>
 #include <fusekit/entry.h>
+#include <fusekit/usage.h>
+#include <fusekit/subtree.h>
 
 namespace fusekit{
 
@@ -15,19 +20,29 @@ namespace fusekit{
 
     typedef symlink_node node;
 
+    symlink_node()
+      : _links( 1 )
+      , _subtree( subtree_size( 1 ) ){
+      usage::instance().add_files( 1 );
+    }
+
+    ~symlink_node(){
+      usage::instance().add_files( -1 );
+    }
+
     entry* find( const char* ){
       return 0;
     }
     
     int links(){
-      return 1;
+      return _links;
     }
 
     int opendir( fuse_file_info& ){
       return -ENOTDIR;
     }
 
-    int readdir( void*, fuse_fill_dir_t, off_t, fuse_file_info& ){
+    int readdir( void*, fill_dir_t, off_t, fuse_file_info& ){
       return -ENOTDIR;
     }
 
@@ -54,6 +69,72 @@ namespace fusekit{
     int symlink( const char* name, const char* target ){
       return -ENOTDIR;
     }
+
+    int freeze( bool ){
+      return -ENOTDIR;
+    }
+
+    int rename( const char*, entry&, const char*, unsigned int ){
+      return -ENOTDIR;
+    }
+
+    int attach( const char*, entry* ){
+      return -ENOTDIR;
+    }
+
+    entry* detach( const char* ){
+      return 0;
+    }
+
+    int link( const char*, entry& ){
+      return -ENOTDIR;
+    }
+
+    /// the entry may be linked into several directories.
+    int hold(){
+      ++_links;
+      return 0;
+    }
+
+    int drop(){
+      return --_links;
+    }
+
+    int scan( const std::string&, child_visitor& ){
+      return -ENOTDIR;
+    }
+
+    subtree_size subtree(){
+      return subtree_size();
+    }
+
+    subtree_size adopted( entry* parent ){
+      _subtree.refresh( *this );
+      return _subtree.adopt( parent );
+    }
+
+    subtree_size orphaned( entry* parent ){
+      return _subtree.orphan( parent );
+    }
+
+    void add_subtree( const subtree_size& ){
+    }
+
+    unsigned long generation(){
+      return 0;
+    }
+
+    /// the entry counts itself with its size and blocks.
+    subtree_size own_size(){
+      struct stat st;
+      ::memset( &st, 0, sizeof(st) );
+      static_cast< Derived& >(*this).stat( st );
+      return subtree_size( 1, st.st_size, st.st_blocks );
+    }
+
+  private:
+    std::atomic< int > _links;
+    subtree_node _subtree;
   };
 }
 
@@ -0,0 +1,387 @@
+
+#ifndef __FUSEKIT__TAR_EXPORT_H
+#define __FUSEKIT__TAR_EXPORT_H
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <set>
+#include <string>
+#include <vector>
+#include <fusekit/entry.h>
+#include <fusekit/basic_file.h>
+#include <fusekit/child_index.h>
+#include <fusekit/file_handle.h>
+#include <fusekit/default_permissions.h>
+
+namespace fusekit{
+
+  /// buffer policy of a file reading a tar archive (ustar with gnu long
+  /// names) of a subtree, e.g. for a backup in one sequential read:
+  ///
+  ///   root.add_file( ".fusekit.tar", make_tar_export( root ) );
+  ///   cp /mnt/.fusekit.tar backup.tar
+  ///
+  /// open walks the subtree and builds an index of the members with the
+  /// offsets of their headers, the archive itself is generated by the
+  /// reads: a read finds its member in the index and produces the
+  /// headers, or reads the content of the member, so memory does not
+  /// grow with the content. the index is kept by the open file, reads at
+  /// any offset continue an export, and an unchanged subtree gives the
+  /// same archive on the next open. the member being read stays open,
+  /// and held like a further link, until the reads move on to another
+  /// member, so a sequential export opens every file once.
+  ///
+  /// the members are the directories, regular files and symlinks below
+  /// the root, not the export itself. a file which changes during an
+  /// export keeps the size of the index: longer content is cut, shorter
+  /// or removed content is filled with zeros.
+  template<
+    class Derived
+    >
+  struct tar_buffer {
+    enum { block = 512 };
+
+    tar_buffer()
+      : _root( 0 )
+      , _size( 0 ){
+    }
+
+    /// the root of the exported subtree.
+    void bind( entry* root ){
+      _root = root;
+    }
+
+    int open( fuse_file_info& fi ){
+      if( !_root ){
+        return -ENOENT;
+      }
+      file_handle* fh = new file_handle;
+      std::set< entry* > visited;
+      walk( *_root, "", fh->members, fh->size, visited );
+      fh->size += 2 * block;
+      _size.store( fh->size, std::memory_order_relaxed );
+      fi.fh = reinterpret_cast< uint64_t >( fh );
+      // the content is generated, the size is known after open only
+      fi.direct_io = 1;
+      return 0;
+    }
+
+    int close( fuse_file_info& fi ){
+      if( fi.fh == 0 ){
+        return -EBADF;
+      }
+      file_handle* fh = reinterpret_cast< file_handle* >( fi.fh );
+      release( *fh );
+      delete fh;
+      fi.fh = 0;
+      return 0;
+    }
+
+    int read( char* buf, size_t size, off_t offset, fuse_file_info& fi ){
+      if( fi.fh == 0 ){
+        return -EBADF;
+      }
+      file_handle& fh = *reinterpret_cast< file_handle* >( fi.fh );
+      if( offset < 0 || offset >= fh.size ){
+        return 0;
+      }
+      size = std::min< off_t >( size, fh.size - offset );
+      ::memset( buf, 0, size );
+      // the member containing offset, the trailer is zeros
+      size_t i = std::upper_bound( fh.members.begin(), fh.members.end(), offset, starts_after ) - fh.members.begin();
+      i = i ? i - 1 : 0;
+      off_t position = offset;
+      const off_t end = offset + size;
+      for( ; i < fh.members.size() && position < end; ++i ){
+        const member& m = fh.members[i];
+        const std::string h = headers( m );
+        const off_t data = m.offset + h.size();
+        if( position < data ){
+          const size_t count = std::min( data, end ) - position;
+          ::memcpy( buf + ( position - offset ), h.data() + ( position - m.offset ), count );
+          position += count;
+        }
+        if( position < end && position < data + m.size ){
+          const size_t count = std::min( data + m.size, end ) - position;
+          content( fh, i, buf + ( position - offset ), count, position - data );
+        }
+        position = std::max( position, std::min( end, data + padded( m.size ) ) );
+      }
+      return size;
+    }
+
+    int write( const char*, size_t, off_t, fuse_file_info& ){
+      return -EBADF;
+    }
+
+    /// the size of the archive at the last open.
+    off_t size(){
+      return _size.load( std::memory_order_relaxed );
+    }
+
+    blkcnt_t blocks(){
+      return 0;
+    }
+
+    int flush( fuse_file_info& fi ){
+      return fi.fh ? 0 : -EBADF;
+    }
+
+    int truncate( off_t ){
+      return -EACCES;
+    }
+
+    int readlink( char*, size_t ){
+      return -EINVAL;
+    }
+
+    off_t lseek( off_t offset, int whence, fuse_file_info& fi ){
+      const off_t end = fi.fh ? reinterpret_cast< file_handle* >( fi.fh )->size : size();
+      if( offset < 0 || offset >= end ){
+        return -ENXIO;
+      }
+      return whence == SEEK_DATA ? offset : end;
+    }
+
+    int fallocate( int, off_t, off_t, fuse_file_info& ){
+      return -EOPNOTSUPP;
+    }
+
+    ssize_t copy_file_range( fuse_file_info&, off_t, entry&, fuse_file_info&, off_t, size_t, int ){
+      return -EOPNOTSUPP;
+    }
+
+  private:
+    /// a member of the archive, found again by its path when its content
+    /// is read: it may be gone meanwhile.
+    struct member {
+      std::string path;
+      std::string link;
+      char type;
+      mode_t mode;
+      time_t mtime;
+      off_t size;
+      /// the offset of its first header.
+      off_t offset;
+    };
+
+    struct file_handle : ::fusekit::file_handle {
+      file_handle()
+        : size( 0 )
+        , current( ~size_t( 0 ) )
+        , open( 0 ){
+        ::memset( &fi, 0, sizeof(fi) );
+      }
+      std::vector< member > members;
+      off_t size;
+      /// the index of the member read last, and its entry if it is open.
+      size_t current;
+      entry* open;
+      fuse_file_info fi;
+    };
+
+    struct name_collector : public child_visitor {
+      explicit name_collector( std::vector< std::string >& n )
+        : names( n ){
+      }
+      void operator()( const std::string& name, entry* ){
+        names.push_back( name );
+      }
+      std::vector< std::string >& names;
+    };
+
+    static bool starts_after( off_t offset, const member& m ){
+      return offset < m.offset;
+    }
+
+    static off_t padded( off_t size ){
+      return ( size + block - 1 ) / block * block;
+    }
+
+    /// adds the members below directory, sorted by name. a directory
+    /// linked more than once is archived once.
+    void walk( entry& directory, const std::string& prefix, std::vector< member >& members, off_t& size, std::set< entry* >& visited ){
+      if( !visited.insert( &directory ).second ){
+        return;
+      }
+      std::vector< std::string > names;
+      name_collector collector( names );
+      directory.scan( "", collector );
+      std::sort( names.begin(), names.end() );
+      for( size_t i = 0; i < names.size(); ++i ){
+        entry* e = directory.child( names[i].c_str() );
+        if( !e || e == static_cast< Derived* >(this) ){
+          continue;
+        }
+        struct stat st;
+        ::memset( &st, 0, sizeof(st) );
+        if( e->stat( st ) != 0 ){
+          continue;
+        }
+        member m;
+        m.path = prefix + names[i];
+        m.mode = st.st_mode & 07777;
+        m.mtime = st.st_mtim.tv_sec;
+        m.size = 0;
+        m.offset = size;
+        if( S_ISDIR( st.st_mode ) ){
+          m.type = '5';
+          m.path += '/';
+        }
+        else if( S_ISLNK( st.st_mode ) ){
+          char target[ 4096 ] = { 0 };
+          if( e->readlink( target, sizeof(target) - 1 ) != 0 ){
+            continue;
+          }
+          m.type = '2';
+          m.link = target;
+        }
+        else if( S_ISREG( st.st_mode ) ){
+          m.type = '0';
+          m.size = st.st_size;
+        }
+        else{
+          continue;
+        }
+        size += headers( m ).size() + padded( m.size );
+        members.push_back( m );
+        if( m.type == '5' ){
+          walk( *e, m.path, members, size, visited );
+        }
+      }
+    }
+
+    /// the header blocks of m: gnu long name and long link headers if
+    /// the names do not fit into the ustar header.
+    static std::string headers( const member& m ){
+      std::string h;
+      if( m.path.size() > 100 ){
+        long_name( h, 'L', m.path );
+      }
+      if( m.link.size() > 100 ){
+        long_name( h, 'K', m.link );
+      }
+      h += header( m.path.substr( 0, 100 ), m.type, m.mode, m.mtime, m.size, m.link.substr( 0, 100 ) );
+      return h;
+    }
+
+    static void long_name( std::string& h, char type, const std::string& name ){
+      h += header( "././@LongLink", type, 0644, 0, name.size() + 1, "" );
+      std::string data( name );
+      data.resize( padded( name.size() + 1 ), 0 );
+      h += data;
+    }
+
+    static std::string header( const std::string& name, char type, mode_t mode, time_t mtime, off_t size, const std::string& link ){
+      char h[ block ];
+      ::memset( h, 0, sizeof(h) );
+      ::memcpy( h, name.data(), name.size() );
+      octal( h + 100, 8, mode );
+      octal( h + 108, 8, ::getuid() );
+      octal( h + 116, 8, ::getgid() );
+      octal( h + 124, 12, size );
+      octal( h + 136, 12, mtime );
+      h[156] = type;
+      ::memcpy( h + 157, link.data(), link.size() );
+      ::memcpy( h + 257, "ustar", 6 );
+      ::memcpy( h + 263, "00", 2 );
+      // the checksum is computed with blanks in its field
+      ::memset( h + 148, ' ', 8 );
+      unsigned sum = 0;
+      for( size_t i = 0; i < sizeof(h); ++i ){
+        sum += static_cast< unsigned char >( h[i] );
+      }
+      ::snprintf( h + 148, 8, "%06o", sum );
+      h[155] = ' ';
+      return std::string( h, sizeof(h) );
+    }
+
+    /// value as octal number of size - 1 digits and a null, or base 256
+    /// (the gnu extension) if it does not fit.
+    static void octal( char* field, size_t size, unsigned long long value ){
+      if( value >> ( 3 * ( size - 1 ) ) ){
+        for( size_t i = size - 1; i > 0; --i, value >>= 8 ){
+          field[i] = static_cast< char >( value & 0xff );
+        }
+        field[0] = static_cast< char >( 0x80 );
+        return;
+      }
+      char digits[32];
+      ::snprintf( digits, sizeof(digits), "%0*llo", static_cast< int >( size - 1 ), value );
+      ::memcpy( field, digits, size );
+    }
+
+    /// count bytes of the content of member i from offset, zeros if the
+    /// member is gone or shorter. the member is opened when the reads
+    /// reach it, the previous one is released.
+    void content( file_handle& fh, size_t i, char* buf, size_t count, off_t offset ){
+      if( fh.current != i ){
+        release( fh );
+        fh.current = i;
+        const std::string& path = fh.members[i].path;
+        entry* e = _root;
+        for( size_t begin = 0; e && begin < path.size(); ){
+          const size_t slash = std::min( path.find( '/', begin ), path.size() );
+          e = e->child( path.substr( begin, slash - begin ).c_str() );
+          begin = slash + 1;
+        }
+        // held, so a removal while the member is open does not delete it
+        if( e && e->hold() == 0 ){
+          ::memset( &fh.fi, 0, sizeof(fh.fi) );
+          fh.fi.flags = O_RDONLY;
+          if( e->open( fh.fi ) == 0 ){
+            fh.open = e;
+          }
+          else if( e->drop() == 0 ){
+            delete e;
+          }
+        }
+      }
+      if( !fh.open ){
+        return;
+      }
+      for( size_t done = 0; done < count; ){
+        const int res = fh.open->read( buf + done, count - done, offset + done, fh.fi );
+        if( res <= 0 ){
+          break;
+        }
+        done += res;
+      }
+    }
+
+    static void release( file_handle& fh ){
+      if( !fh.open ){
+        return;
+      }
+      fh.open->release( fh.fi );
+      if( fh.open->drop() == 0 ){
+        delete fh.open;
+      }
+      fh.open = 0;
+    }
+
+    entry* _root;
+    std::atomic< off_t > _size;
+  };
+
+  typedef basic_file< tar_buffer, default_time, default_ro_file_permissions > tar_export;
+
+  /// an export of the subtree of root, to be added below it.
+  inline
+  tar_export* make_tar_export( entry& root ){
+    tar_export* t = new tar_export;
+    t->bind( &root );
+    return t;
+  }
+
+}
+
+#endif
+
+
+
@@ -62,6 +62,26 @@ namespace fusekit{
       _os << "tracer_buffer::readlink(...)" << std::endl;
       return -EINVAL;
     }
+
+    blkcnt_t blocks(){
+      _os << "tracer_buffer::blocks(...)" << std::endl;
+      return 0;
+    }
+
+    off_t lseek( off_t, int, fuse_file_info& ){
+      _os << "tracer_buffer::lseek(...)" << std::endl;
+      return -ENXIO;
+    }
+
+    int fallocate( int, off_t, off_t, fuse_file_info& ){
+      _os << "tracer_buffer::fallocate(...)" << std::endl;
+      return -EOPNOTSUPP;
+    }
+
+    ssize_t copy_file_range( fuse_file_info&, off_t, entry&, fuse_file_info&, off_t, size_t, int ){
+      _os << "tracer_buffer::copy_file_range(...)" << std::endl;
+      return -EOPNOTSUPP;
+    }
   private:
     std::ostream&_os;
   };
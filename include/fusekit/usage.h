@@ -0,0 +1,142 @@
+
+#ifndef __FUSEKIT__USAGE_H
+#define __FUSEKIT__USAGE_H
+
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/statvfs.h>
+#include <atomic>
+
+namespace fusekit{
+
+  /// live accounting of the file system, reported by the daemon's statfs.
+  ///
+  /// the counters are maintained incrementally: the node policies count
+  /// files, symlinks and directories when they are constructed and
+  /// destroyed, memory backed files count the bytes of their storage when
+  /// pages are allocated and released. statfs therefore never walks the tree.
+  ///
+  /// capacity limits are checked before anything is allocated, so a full
+  /// file system rejects creates and growing writes with -ENOSPC right
+  /// away. the check does not reserve, so concurrent writers may overshoot
+  /// a limit by the storage they allocate at the same time.
+  ///
+  /// the counters and limits are process wide, so the daemons of a
+  /// process share one budget. the daemon reports the inodes of its own
+  /// tree in statfs.
+  struct usage {
+    static const unsigned long block_size = 4096;
+
+    static usage& instance(){
+      static usage u;
+      return u;
+    }
+
+    /// sets the limits, 0 means unlimited.
+    void set_capacity( unsigned long long bytes, unsigned long long inodes ){
+      _byte_limit.store( bytes, std::memory_order_relaxed );
+      _inode_limit.store( inodes, std::memory_order_relaxed );
+    }
+
+    void add_files( long n ){
+      _files.fetch_add( n, std::memory_order_relaxed );
+    }
+
+    void add_directories( long n ){
+      _directories.fetch_add( n, std::memory_order_relaxed );
+    }
+
+    void add_bytes( long long n ){
+      _bytes.fetch_add( n, std::memory_order_relaxed );
+    }
+
+    unsigned long long files() const {
+      return _files.load( std::memory_order_relaxed );
+    }
+
+    unsigned long long directories() const {
+      return _directories.load( std::memory_order_relaxed );
+    }
+
+    unsigned long long bytes() const {
+      return _bytes.load( std::memory_order_relaxed );
+    }
+
+    /// 0 if another inode fits, -ENOSPC otherwise.
+    int check_inode() const {
+      const unsigned long long limit = _inode_limit.load( std::memory_order_relaxed );
+      return limit && files() + directories() >= limit ? -ENOSPC : 0;
+    }
+
+    /// 0 if n more bytes fit, -ENOSPC otherwise.
+    int check_bytes( unsigned long long n ) const {
+      const unsigned long long limit = _byte_limit.load( std::memory_order_relaxed );
+      return limit && bytes() + n > limit ? -ENOSPC : 0;
+    }
+
+    /// without a byte limit the available physical memory is reported as
+    /// free space, without an inode limit there are always free inodes.
+    int statfs( struct statvfs& st ) const {
+      return statfs( st, files() + directories() );
+    }
+
+    /// like statfs above, with inodes used instead of the process wide count.
+    int statfs( struct statvfs& st, unsigned long long inodes ) const {
+      ::memset( &st, 0, sizeof(st) );
+      const unsigned long long used = ( bytes() + block_size - 1 ) / block_size;
+      const unsigned long long byte_limit = _byte_limit.load( std::memory_order_relaxed );
+      unsigned long long free = 0;
+      if( byte_limit ){
+        const unsigned long long total = byte_limit / block_size;
+        free = total > used ? total - used : 0;
+      }
+      else{
+        const long pages = ::sysconf( _SC_AVPHYS_PAGES );
+        const long page = ::sysconf( _SC_PAGESIZE );
+        if( pages > 0 && page > 0 ){
+          free = static_cast< unsigned long long >( pages ) * page / block_size;
+        }
+      }
+      st.f_bsize = block_size;
+      st.f_frsize = block_size;
+      st.f_blocks = used + free;
+      st.f_bfree = free;
+      st.f_bavail = free;
+
+      const unsigned long long inode_limit = _inode_limit.load( std::memory_order_relaxed );
+      const unsigned long long total_inodes = inode_limit ? inode_limit : inodes + unlimited_inodes;
+      st.f_files = total_inodes;
+      st.f_ffree = total_inodes > inodes ? total_inodes - inodes : 0;
+      st.f_favail = st.f_ffree;
+      st.f_namemax = 255;
+      return 0;
+    }
+
+  private:
+    static const unsigned long long unlimited_inodes = 1ULL << 31;
+
+    usage()
+      : _files( 0 )
+      , _directories( 0 )
+      , _bytes( 0 )
+      , _byte_limit( 0 )
+      , _inode_limit( 0 ){
+    }
+
+    usage( const usage& );
+    usage& operator=( const usage& );
+
+    std::atomic< long > _files;
+    std::atomic< long > _directories;
+    std::atomic< long long > _bytes;
+    std::atomic< unsigned long long > _byte_limit;
+    std::atomic< unsigned long long > _inode_limit;
+  };
+
+}
+
+#endif
+
+
+
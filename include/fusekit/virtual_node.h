@@ -0,0 +1,164 @@
+
+#ifndef __FUSEKIT__VIRTUAL_NODE_H
+#define __FUSEKIT__VIRTUAL_NODE_H
+
+#include <map>
+#include <list>
+#include <mutex>
+#include <string>
+#include <fusekit/entry.h>
+#include <fusekit/child_index.h>
+#include <fusekit/reclaim.h>
+
+namespace fusekit{
+
+  /// base of the node policies of generated directories, whose children
+  /// are computed when they are looked up (see query_directory and
+  /// xattr_directory).
+  ///
+  /// the directory cannot be changed through the file system, it is not
+  /// counted in the subtree sizes and it is left alone by freeze.
+  /// the derived policy provides find, readdir and scan.
+  struct virtual_node {
+
+    int links(){
+      return 2;
+    }
+
+    int opendir( fuse_file_info& ){
+      return 0;
+    }
+
+    int releasedir( fuse_file_info& ){
+      return 0;
+    }
+
+    int mknod( const char*, mode_t, dev_t ){
+      return -EROFS;
+    }
+
+    int unlink( const char* ){
+      return -EROFS;
+    }
+
+    int mkdir( const char*, mode_t ){
+      return -EROFS;
+    }
+
+    int rmdir( const char* ){
+      return -EROFS;
+    }
+
+    int symlink( const char*, const char* ){
+      return -EROFS;
+    }
+
+    int rename( const char*, entry&, const char*, unsigned int ){
+      return -EROFS;
+    }
+
+    int attach( const char*, entry* ){
+      return -EROFS;
+    }
+
+    entry* detach( const char* ){
+      return 0;
+    }
+
+    int link( const char*, entry& ){
+      return -EROFS;
+    }
+
+    int hold(){
+      return -EPERM;
+    }
+
+    int drop(){
+      return 0;
+    }
+
+    int freeze( bool ){
+      return 0;
+    }
+
+    subtree_size subtree(){
+      return subtree_size();
+    }
+
+    subtree_size adopted( entry* ){
+      return subtree_size();
+    }
+
+    subtree_size orphaned( entry* ){
+      return subtree_size();
+    }
+
+    void add_subtree( const subtree_size& ){
+    }
+
+    unsigned long generation(){
+      return 0;
+    }
+  };
+
+  /// the generated directories of a virtual tree, which are created
+  /// on lookup.
+  ///
+  /// the cache keeps the most recently used ones. evicted directories
+  /// are retired (see reclaim), so an rcu_lock daemon may still use
+  /// them in operations which are running. the daemon resolves the path
+  /// for each operation, so it never keeps them longer.
+  struct virtual_cache {
+    static const size_t capacity = 256;
+
+    virtual_cache(){
+    }
+
+    ~virtual_cache(){
+      entries_t::iterator i = _entries.begin();
+      while( i != _entries.end() ){
+        delete i->second.first;
+        ++i;
+      }
+    }
+
+    /// the entry cached as key. if there is none, create() is called
+    /// (with the cache locked) to make it.
+    template< class Create >
+    entry* get( const std::string& key, Create create ){
+      std::lock_guard< std::mutex > guard( _mutex );
+      entries_t::iterator i = _entries.find( key );
+      if( i != _entries.end() ){
+        _order.splice( _order.end(), _order, i->second.second );
+        return i->second.first;
+      }
+      entry* e = create();
+      _entries[ key ] = std::make_pair( e, _order.insert( _order.end(), key ) );
+      if( _order.size() > capacity ){
+        i = _entries.find( _order.front() );
+        reclaim::retire( i->second.first );
+        _entries.erase( i );
+        _order.pop_front();
+      }
+      return e;
+    }
+
+  private:
+    virtual_cache( const virtual_cache& );
+    virtual_cache& operator=( const virtual_cache& );
+
+    typedef std::list< std::string > order_t;
+    typedef std::map< std::string, std::pair< entry*, order_t::iterator > > entries_t;
+
+    std::mutex _mutex;
+    entries_t _entries;
+    /// the keys, most recently used last.
+    order_t _order;
+  };
+
+}
+
+#endif
+
+
+
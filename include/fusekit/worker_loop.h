@@ -0,0 +1,273 @@
+
+#ifndef __FUSEKIT__WORKER_LOOP_H
+#define __FUSEKIT__WORKER_LOOP_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+#ifdef __linux__
+#include <sched.h>
+#endif
+#include <fusekit/fuse.h>
+#include <fusekit/mount_options.h>
+
+#if defined(__linux__) && !defined(FUSE_DEV_IOC_CLONE)
+#define FUSE_DEV_IOC_CLONE _IOR( 229, 0, uint32_t )
+#endif
+
+namespace fusekit{
+
+  struct worker_loop;
+
+#if FUSE_USE_VERSION > 26 && FUSE_VERSION >= FUSE_MAKE_VERSION(2, 9)
+  /// the multithreaded loop of daemon_base::serve if mount_options::threads
+  /// is set: a fixed number of worker threads, each optionally bound to a
+  /// cpu (pin_threads).
+  ///
+  /// with clone_fd every worker reads the requests from a device file of
+  /// its own, cloned from the one of the mount (FUSE_DEV_IOC_CLONE), and
+  /// writes the replies to it, so the workers do not contend for one file.
+  /// a worker falls back to the shared file if cloning fails. fuse 3
+  /// keeps its channels internal: there serve rejects clone_fd together
+  /// with worker threads, the loop of fuse clones the files without them.
+  ///
+  /// like the loop of fuse, a worker blocks in the read of the next
+  /// request, which wakes one waiting worker only. the loop stops when
+  /// the file system is unmounted or exit is called, the workers which
+  /// still wait for a request are cancelled.
+  struct worker_loop {
+    worker_loop( struct fuse* f, const mount_options& options )
+      : _fuse( f )
+      , _session( fuse_get_session( f ) )
+      , _options( options )
+      , _stop( false )
+      , _err( 0 ){
+#if FUSE_USE_VERSION >= 30
+      _fd = fuse_session_fd( _session );
+      _bufsize = 0;
+#else
+      struct fuse_chan* channel = fuse_session_next_chan( _session, NULL );
+      _fd = fuse_chan_fd( channel );
+      _bufsize = fuse_chan_bufsize( channel );
+#endif
+#ifdef __linux__
+      cpu_set_t set;
+      CPU_ZERO( &set );
+      if( options.pin_threads && ::sched_getaffinity( 0, sizeof(set), &set ) == 0 ){
+        for( int cpu = 0; cpu < CPU_SETSIZE; ++cpu ){
+          if( CPU_ISSET( cpu, &set ) ){
+            _cpus.push_back( cpu );
+          }
+        }
+      }
+#endif
+    }
+
+    /// serves the requests until the loop stops, returns 0 or the error
+    /// which stopped it.
+    int run(){
+      std::vector< worker > workers( _options.threads ? _options.threads : 1 );
+      for( size_t i = 0; i < workers.size(); ++i ){
+        open( workers[i] );
+      }
+      fuse_start_cleanup_thread( _fuse );
+      for( size_t i = 0; i < workers.size(); ++i ){
+        workers[i].thread = std::thread( &worker_loop::work, this, &workers[i], i );
+      }
+      {
+        std::unique_lock< std::mutex > guard( _mutex );
+        while( !_stop ){
+          _stopped.wait( guard );
+        }
+      }
+      for( size_t i = 0; i < workers.size(); ++i ){
+        ::pthread_cancel( workers[i].thread.native_handle() );
+        workers[i].thread.join();
+        close( workers[i] );
+      }
+      fuse_stop_cleanup_thread( _fuse );
+      return _err;
+    }
+
+    /// stops the loop.
+    void exit(){
+      fuse_session_exit( _session );
+      std::lock_guard< std::mutex > guard( _mutex );
+      _stop = true;
+      _stopped.notify_all();
+    }
+
+  private:
+    struct worker {
+      worker()
+        : fd( -1 )
+        , channel( 0 ){
+        ::memset( &buf, 0, sizeof(buf) );
+      }
+      std::thread thread;
+      int fd;
+      struct fuse_chan* channel;
+      std::vector< char > buffer;
+      struct fuse_buf buf;
+    };
+
+    void open( worker& w ){
+#if FUSE_USE_VERSION < 30
+      w.fd = _options.clone_fd ? clone( _fd ) : -1;
+      if( w.fd < 0 ){
+        w.fd = _fd;
+      }
+      static struct fuse_chan_ops ops = { &worker_loop::receive, &worker_loop::send, &worker_loop::destroy };
+      w.channel = fuse_chan_new( &ops, w.fd, _bufsize, this );
+      w.buffer.resize( _bufsize );
+#endif
+    }
+
+    void close( worker& w ){
+#if FUSE_USE_VERSION < 30
+      if( w.channel ){
+        fuse_chan_destroy( w.channel );
+      }
+#else
+      ::free( w.buf.mem );
+#endif
+    }
+
+    /// the loop of a worker. the worker can be cancelled while it waits
+    /// for a request only, not while it processes one.
+    void work( worker* w, size_t index ){
+      ::pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, NULL );
+      pin( index );
+      int err = 0;
+      while( !fuse_session_exited( _session ) ){
+#if FUSE_USE_VERSION >= 30
+        ::pthread_setcancelstate( PTHREAD_CANCEL_ENABLE, NULL );
+        const int res = fuse_session_receive_buf( _session, &w->buf );
+        ::pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, NULL );
+#else
+        ::memset( &w->buf, 0, sizeof(w->buf) );
+        w->buf.mem = &w->buffer[0];
+        w->buf.size = w->buffer.size();
+        struct fuse_chan* channel = w->channel;
+        ::pthread_setcancelstate( PTHREAD_CANCEL_ENABLE, NULL );
+        const int res = fuse_session_receive_buf( _session, &w->buf, &channel );
+        ::pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, NULL );
+#endif
+        if( res == -EINTR || res == -EAGAIN ){
+          continue;
+        }
+        if( res <= 0 ){
+          err = res;
+          fuse_session_exit( _session );
+          break;
+        }
+#if FUSE_USE_VERSION >= 30
+        fuse_session_process_buf( _session, &w->buf );
+#else
+        fuse_session_process_buf( _session, &w->buf, channel );
+#endif
+      }
+      std::lock_guard< std::mutex > guard( _mutex );
+      if( err && !_err ){
+        _err = err;
+      }
+      _stop = true;
+      _stopped.notify_all();
+    }
+
+    void pin( size_t index ){
+#ifdef __linux__
+      if( !_cpus.empty() ){
+        cpu_set_t set;
+        CPU_ZERO( &set );
+        CPU_SET( _cpus[ index % _cpus.size() ], &set );
+        ::pthread_setaffinity_np( ::pthread_self(), sizeof(set), &set );
+      }
+#endif
+    }
+
+#if FUSE_USE_VERSION < 30
+    /// a device file attached to the connection of fd, -1 if the kernel
+    /// cannot clone it.
+    static int clone( int fd ){
+#ifdef __linux__
+      const int c = ::open( "/dev/fuse", O_RDWR | O_CLOEXEC );
+      if( c < 0 ){
+        return -1;
+      }
+      uint32_t master = fd;
+      if( ::ioctl( c, FUSE_DEV_IOC_CLONE, &master ) != 0 ){
+        ::close( c );
+        return -1;
+      }
+      return c;
+#else
+      return -1;
+#endif
+    }
+
+    /// the channel of a worker: reads and writes its device file.
+    static int receive( struct fuse_chan** channel, char* buf, size_t size ){
+      worker_loop& l = *static_cast< worker_loop* >( fuse_chan_data( *channel ) );
+      for( ;; ){
+        const ssize_t res = ::read( fuse_chan_fd( *channel ), buf, size );
+        if( res >= 0 ){
+          return res;
+        }
+        if( errno == ENOENT ){
+          // the request has been interrupted
+          continue;
+        }
+        if( errno == ENODEV ){
+          // unmounted
+          fuse_session_exit( l._session );
+          return 0;
+        }
+        return -errno;
+      }
+    }
+
+    static int send( struct fuse_chan* channel, const struct iovec iov[], size_t count ){
+      if( ::writev( fuse_chan_fd( channel ), iov, count ) < 0 ){
+        return -errno;
+      }
+      return 0;
+    }
+
+    static void destroy( struct fuse_chan* channel ){
+      worker_loop& l = *static_cast< worker_loop* >( fuse_chan_data( channel ) );
+      if( fuse_chan_fd( channel ) != l._fd ){
+        ::close( fuse_chan_fd( channel ) );
+      }
+    }
+#endif
+
+    struct fuse* _fuse;
+    struct fuse_session* _session;
+    const mount_options _options;
+    int _fd;
+    size_t _bufsize;
+    std::vector< int > _cpus;
+
+    std::mutex _mutex;
+    std::condition_variable _stopped;
+    bool _stop;
+    int _err;
+  };
+#endif
+
+}
+
+#endif
+
+
+
@@ -0,0 +1,210 @@
+
+#ifndef __FUSEKIT__XATTR_DIRECTORY_H
+#define __FUSEKIT__XATTR_DIRECTORY_H
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <fusekit/entry.h>
+#include <fusekit/child_index.h>
+#include <fusekit/virtual_node.h>
+#include <fusekit/xattr_index.h>
+#include <fusekit/basic_directory.h>
+
+namespace fusekit{
+
+  /// encodes an attribute name or value as a file name: '%', '/' and
+  /// nul are written as %xx, as are the values "", "." and "..".
+  inline
+  std::string xattr_encode( const std::string& value ){
+    if( value.empty() ){
+      return "%";
+    }
+    const bool dots = value == "." || value == "..";
+    std::string name;
+    for( size_t i = 0; i < value.size(); ++i ){
+      const char c = value[i];
+      if( c == '%' || c == '/' || c == '\0' || ( dots && c == '.' ) ){
+        char escaped[4];
+        ::snprintf( escaped, sizeof(escaped), "%%%02X", static_cast< unsigned char >( c ) );
+        name += escaped;
+      }
+      else{
+        name += c;
+      }
+    }
+    return name;
+  }
+
+  /// the inverse of xattr_encode, false if name is not an encoding.
+  inline
+  bool xattr_decode( const std::string& name, std::string& value ){
+    value.clear();
+    if( name == "%" ){
+      return true;
+    }
+    for( size_t i = 0; i < name.size(); ++i ){
+      if( name[i] != '%' ){
+        value += name[i];
+        continue;
+      }
+      if( i + 2 >= name.size() || !::isxdigit( name[i+1] ) || !::isxdigit( name[i+2] ) ){
+        return false;
+      }
+      value += static_cast< char >( ::strtoul( name.substr( i + 1, 2 ).c_str(), 0, 16 ) );
+      i += 2;
+    }
+    return true;
+  }
+
+  /// node policy of the directories of an xattr_directory, e.g. /.xattr.
+  ///
+  /// the root lists the indexed attribute names, /.xattr/<name> lists
+  /// their values and /.xattr/<name>/<value> contains the entries whose
+  /// attribute name is value, named by their serial number in the
+  /// xattr_index. names and values are encoded by xattr_encode.
+  /// ls /.xattr/user.state/ready costs O(matches), independent of the
+  /// size of the tree. the matches are the entries themselves, so they can
+  /// be read and written there. values longer than a file name are
+  /// indexed but not listed.
+  template<
+    class Derived
+    >
+  struct xattr_node
+    : public virtual_node {
+
+    xattr_node()
+      : _cache( 0 )
+      , _level( 0 ){
+    }
+
+    /// makes the node the root of the xattr directory.
+    void bind(){
+      _owned.reset( new virtual_cache );
+      _cache = _owned.get();
+    }
+
+    entry* find( const char* child ){
+      if( !_cache ){
+        return 0;
+      }
+      if( _level == 2 ){
+        char* end = 0;
+        const xattr_index::serial_type serial = ::strtoull( child, &end, 10 );
+        if( *child < '1' || *child > '9' || *end ){
+          return 0;
+        }
+        return xattr_index::instance().find( _name, _value, serial );
+      }
+      std::string decoded;
+      if( !xattr_decode( child, decoded ) ){
+        return 0;
+      }
+      if( _level == 0 ){
+        if( !xattr_index::instance().contains( decoded ) ){
+          return 0;
+        }
+        create c = { *this, decoded, "" };
+        return _cache->get( std::string( 1, '\1' ) + decoded, c );
+      }
+      if( !xattr_index::instance().contains( _name, decoded ) ){
+        return 0;
+      }
+      create c = { *this, _name, decoded };
+      return _cache->get( std::string( 1, '\2' ) + _name + '\0' + decoded, c );
+    }
+
+    int readdir( void* buf, fill_dir_t filler, off_t offset, fuse_file_info& ){
+      const std::vector< std::string > children = list();
+      filler( buf, ".", NULL, offset );
+      filler( buf, "..", NULL, offset );
+      for( size_t i = 0; i < children.size(); ++i ){
+        filler( buf, children[i].c_str(), NULL, offset );
+      }
+      return 0;
+    }
+
+    int scan( const std::string& prefix, child_visitor& visitor ){
+      const std::vector< std::string > children = list();
+      for( size_t i = 0; i < children.size(); ++i ){
+        if( children[i].compare( 0, prefix.size(), prefix ) == 0 ){
+          entry* e = find( children[i].c_str() );
+          if( e ){
+            visitor( children[i], e );
+          }
+        }
+      }
+      return 0;
+    }
+
+  private:
+    static const size_t name_max = 255;
+
+    /// creates the child directories in the cache.
+    struct create {
+      entry* operator()(){
+        Derived* e = new Derived;
+        e->_cache = parent._cache;
+        e->_level = parent._level + 1;
+        e->_name = name;
+        e->_value = value;
+        return e;
+      }
+      xattr_node& parent;
+      const std::string& name;
+      const std::string& value;
+    };
+
+    std::vector< std::string > list(){
+      std::vector< std::string > children;
+      if( !_cache ){
+        return children;
+      }
+      xattr_index& index = xattr_index::instance();
+      if( _level == 2 ){
+        const xattr_index::match_list matches = index.find( _name, _value );
+        for( size_t i = 0; i < matches.size(); ++i ){
+          char serial[24];
+          ::snprintf( serial, sizeof(serial), "%llu", matches[i].first );
+          children.push_back( serial );
+        }
+        return children;
+      }
+      const std::vector< std::string > keys = _level == 0 ? index.names() : index.values( _name );
+      for( size_t i = 0; i < keys.size(); ++i ){
+        const std::string name = xattr_encode( keys[i] );
+        if( name.size() <= name_max ){
+          children.push_back( name );
+        }
+      }
+      return children;
+    }
+
+    std::unique_ptr< virtual_cache > _owned;
+    virtual_cache* _cache;
+    /// 0 for the root, 1 for a name, 2 for a value.
+    int _level;
+    std::string _name;
+    std::string _value;
+  };
+
+  typedef basic_directory< xattr_node > xattr_directory;
+
+  /// a directory listing the xattr_index, to be added to the tree:
+  /// root.add_directory( ".xattr", make_xattr_directory() );
+  inline
+  xattr_directory* make_xattr_directory(){
+    xattr_directory* x = new xattr_directory;
+    x->bind();
+    return x;
+  }
+
+}
+
+#endif
+
+
+
@@ -0,0 +1,192 @@
+
+#ifndef __FUSEKIT__XATTR_INDEX_H
+#define __FUSEKIT__XATTR_INDEX_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <utility>
+#include <fusekit/entry.h>
+
+namespace fusekit{
+
+  /// secondary index of extended attribute values: maps (name, value)
+  /// to the entries carrying that attribute.
+  ///
+  /// the index is maintained by the indexed_xattr policy, entries using
+  /// other attribute policies are not indexed. a lookup costs
+  /// O(log(values) + matches) instead of a walk of the tree. the entries
+  /// do not know their names, so every indexed entry gets a serial
+  /// number, which names it in the xattr_directory.
+  ///
+  /// like the change_log, every daemon owns an index and makes it current
+  /// while it runs an operation. an entry stays in the index it was first
+  /// added to, unless that is the process wide index: an entry tagged
+  /// outside of a scope, e.g. while the application builds the tree,
+  /// moves to the index of the first scope which uses its attributes.
+  struct xattr_index {
+    typedef unsigned long long serial_type;
+    typedef std::vector< std::pair< serial_type, entry* > > match_list;
+
+    xattr_index()
+      : _last( 0 ){
+    }
+
+    /// the current index of the thread, the process wide index outside
+    /// of a scope.
+    static xattr_index& instance(){
+      xattr_index* c = current();
+      return c ? *c : process();
+    }
+
+    /// the index of the entries tagged outside of a scope.
+    static xattr_index& process(){
+      static xattr_index i;
+      return i;
+    }
+
+    /// makes index the current index of this thread.
+    struct scope {
+      explicit scope( xattr_index& index )
+        : _previous( current() ){
+        current() = &index;
+      }
+
+      ~scope(){
+        current() = _previous;
+      }
+
+    private:
+      scope( const scope& );
+      scope& operator=( const scope& );
+      xattr_index* _previous;
+    };
+
+    void add( const std::string& name, const std::string& value, entry* e ){
+      std::lock_guard< std::mutex > guard( _mutex );
+      serials_t::iterator s = _serials.find( e );
+      if( s == _serials.end() ){
+        s = _serials.insert( std::make_pair( e, std::make_pair( ++_last, 0UL ) ) ).first;
+      }
+      ++s->second.second;
+      _names[ name ][ value ][ s->second.first ] = e;
+    }
+
+    void remove( const std::string& name, const std::string& value, entry* e ){
+      std::lock_guard< std::mutex > guard( _mutex );
+      serials_t::iterator s = _serials.find( e );
+      if( s == _serials.end() ){
+        return;
+      }
+      names_t::iterator n = _names.find( name );
+      if( n == _names.end() ){
+        return;
+      }
+      values_t::iterator v = n->second.find( value );
+      if( v == n->second.end() || v->second.erase( s->second.first ) == 0 ){
+        return;
+      }
+      if( v->second.empty() ){
+        n->second.erase( v );
+        if( n->second.empty() ){
+          _names.erase( n );
+        }
+      }
+      if( --s->second.second == 0 ){
+        _serials.erase( s );
+      }
+    }
+
+    /// the indexed attribute names.
+    std::vector< std::string > names(){
+      std::lock_guard< std::mutex > guard( _mutex );
+      std::vector< std::string > result;
+      for( names_t::const_iterator n = _names.begin(); n != _names.end(); ++n ){
+        result.push_back( n->first );
+      }
+      return result;
+    }
+
+    /// the values of the attribute name.
+    std::vector< std::string > values( const std::string& name ){
+      std::lock_guard< std::mutex > guard( _mutex );
+      std::vector< std::string > result;
+      names_t::const_iterator n = _names.find( name );
+      if( n != _names.end() ){
+        for( values_t::const_iterator v = n->second.begin(); v != n->second.end(); ++v ){
+          result.push_back( v->first );
+        }
+      }
+      return result;
+    }
+
+    bool contains( const std::string& name ){
+      std::lock_guard< std::mutex > guard( _mutex );
+      return _names.find( name ) != _names.end();
+    }
+
+    bool contains( const std::string& name, const std::string& value ){
+      std::lock_guard< std::mutex > guard( _mutex );
+      const matches_t* m = matches( name, value );
+      return m != 0;
+    }
+
+    /// the entries whose attribute name is value, ordered by serial.
+    match_list find( const std::string& name, const std::string& value ){
+      std::lock_guard< std::mutex > guard( _mutex );
+      match_list result;
+      const matches_t* m = matches( name, value );
+      if( m ){
+        result.assign( m->begin(), m->end() );
+      }
+      return result;
+    }
+
+    /// the entry with serial if its attribute name is value, or 0.
+    entry* find( const std::string& name, const std::string& value, serial_type serial ){
+      std::lock_guard< std::mutex > guard( _mutex );
+      const matches_t* m = matches( name, value );
+      if( !m ){
+        return 0;
+      }
+      matches_t::const_iterator i = m->find( serial );
+      return i != m->end() ? i->second : 0;
+    }
+
+  private:
+    typedef std::map< serial_type, entry* > matches_t;
+    typedef std::map< std::string, matches_t > values_t;
+    typedef std::map< std::string, values_t > names_t;
+    /// serial and number of indexed attributes of each entry.
+    typedef std::map< entry*, std::pair< serial_type, unsigned long > > serials_t;
+
+    static xattr_index*& current(){
+      static thread_local xattr_index* c = 0;
+      return c;
+    }
+
+    xattr_index( const xattr_index& );
+    xattr_index& operator=( const xattr_index& );
+
+    const matches_t* matches( const std::string& name, const std::string& value ) const {
+      names_t::const_iterator n = _names.find( name );
+      if( n == _names.end() ){
+        return 0;
+      }
+      values_t::const_iterator v = n->second.find( value );
+      return v != n->second.end() ? &v->second : 0;
+    }
+
+    std::mutex _mutex;
+    names_t _names;
+    serials_t _serials;
+    serial_type _last;
+  };
+
+}
+
+#endif
+
+
+